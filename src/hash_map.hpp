@@ -3,50 +3,577 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <initializer_list>
 #include <iostream>
+#include <iterator>
 #include <limits>
-#include <list>
+#include <memory>
+#include <new>
+#include <optional>
+#include <random>
 #include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
-template <typename KeyType, typename ValueType, typename Hash = std::hash<KeyType>>
-class HashMap {
+// Tag matching uses the widest vector extension the compiler targets, HASH_MAP_NO_SIMD forces the scalar loop
+#if !defined(HASH_MAP_NO_SIMD) && defined(__AVX2__)
+#define HASH_MAP_USE_AVX2
+#include <immintrin.h>
+#elif !defined(HASH_MAP_NO_SIMD) && defined(__SSE2__)
+#define HASH_MAP_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+// Capacities are powers of two and the home bucket is taken from the high bits of a Fibonacci product,
+// so no division happens on the lookup path
+class PowerOfTwoGrowthPolicy {
+public:
+    explicit PowerOfTwoGrowthPolicy(size_t min_capacity) {
+        while (shift_ > 1 && Capacity() < min_capacity) {
+            --shift_;
+        }
+    }
+
+    size_t Capacity() const {
+        return size_t{1} << (std::numeric_limits<uint64_t>::digits - shift_);
+    }
+
+    size_t NextCapacity() const {
+        return Capacity() * 2;
+    }
+
+    size_t GetBucket(size_t hash) const {
+        return static_cast<size_t>((static_cast<uint64_t>(hash) * FIBONACCI_MULTIPLIER) >> shift_);
+    }
+
+private:
+    static constexpr uint64_t FIBONACCI_MULTIPLIER = 11400714819323198485ull;  // 2^64 / golden ratio
+
+    unsigned shift_ = std::numeric_limits<uint64_t>::digits - 1;
+};
+
+namespace hash_map_detail {
+
+inline constexpr std::array<size_t, 39> PRIMES = {
+    5ul,         17ul,        29ul,        37ul,        53ul,         67ul,         79ul,        97ul,
+    131ul,       193ul,       257ul,       389ul,       521ul,       769ul,        1031ul,       1543ul,
+    2053ul,      3079ul,      6151ul,      12289ul,     24593ul,      49157ul,      98317ul,      196613ul,
+    393241ul,    786433ul,    1572869ul,   3145739ul,   6291469ul,    12582917ul,   25165843ul,   50331653ul,
+    100663319ul, 201326611ul, 402653189ul, 805306457ul, 1610612741ul, 3221225473ul, 4294967291ul};
+
+template <size_t Index>
+size_t ModuloPrime(size_t hash) {
+    return hash % PRIMES[Index];
+}
+
+template <size_t... Indices>
+constexpr std::array<size_t (*)(size_t), sizeof...(Indices)> MakeModuloPrimes(std::index_sequence<Indices...>) {
+    return {&ModuloPrime<Indices>...};
+}
+
+inline constexpr std::array<size_t (*)(size_t), PRIMES.size()> MODULO_PRIMES =
+    MakeModuloPrimes(std::make_index_sequence<PRIMES.size()>());
+
+template <typename T, typename = void>
+struct IsTransparent : std::false_type {};
+
+template <typename T>
+struct IsTransparent<T, std::void_t<typename T::is_transparent>> : std::true_type {};
+
+// Holds a functor as a base class when it is empty, so a stateless one takes no space
+template <typename T, bool = std::is_empty_v<T> && !std::is_final_v<T>>
+class EmptyBase {
+public:
+    explicit EmptyBase(const T& value) : value_(value) {
+    }
+
+    const T& Get() const {
+        return value_;
+    }
+
+private:
+    T value_;
+};
+
+template <typename T>
+class EmptyBase<T, true> : private T {
+public:
+    explicit EmptyBase(const T& value) : T(value) {
+    }
+
+    const T& Get() const {
+        return *this;
+    }
+};
+
+template <bool StoreHash>
+struct SlotHash {};
+
+template <>
+struct SlotHash<true> {
+    size_t hash_;
+};
+
+inline size_t FloorLog2(size_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return std::numeric_limits<unsigned long long>::digits - 1 -
+           __builtin_clzll(static_cast<unsigned long long>(value));
+#else
+    size_t result = 0;
+    for (; value > 1; value >>= 1) {
+        ++result;
+    }
+    return result;
+#endif
+}
+
+// An index-addressed array whose elements never move. Block b holds FIRST_BLOCK_SIZE << b elements,
+// so growing allocates one more block and leaves every element, reference and pointer where it was
+template <typename T>
+class BlockArray {
+public:
+    BlockArray() = default;
+
+    BlockArray(const BlockArray& other) {
+        Reserve(other.size_);
+        for (size_t index = 0; index < other.size_; ++index) {
+            EmplaceBack(other[index]);
+        }
+    }
+
+    BlockArray(BlockArray&& other) noexcept : blocks_(std::move(other.blocks_)), size_(other.size_) {
+        other.blocks_.clear();
+        other.size_ = 0;
+    }
+
+    BlockArray& operator=(const BlockArray&) = delete;
+    BlockArray& operator=(BlockArray&&) = delete;
+
+    ~BlockArray() {
+        Clear();
+        std::allocator<T> allocator;
+        for (size_t block = 0; block < blocks_.size(); ++block) {
+            allocator.deallocate(blocks_[block], BlockSize(block));
+        }
+    }
+
+    size_t Size() const {
+        return size_;
+    }
+
+    size_t Capacity() const {
+        return BlockStart(blocks_.size());
+    }
+
+    T& operator[](size_t index) {
+        return *Locate(blocks_.data(), index);
+    }
+
+    const T& operator[](size_t index) const {
+        return *Locate(blocks_.data(), index);
+    }
+
+    // Iterators walk the block table directly, it only changes when a block is added
+    T* const* Blocks() const {
+        return blocks_.data();
+    }
+
+    template <typename... Args>
+    T& EmplaceBack(Args&&... args) {
+        if (size_ == Capacity()) {
+            AddBlock();
+        }
+        T* element = &(*this)[size_];
+        new (element) T(std::forward<Args>(args)...);
+        ++size_;
+        return *element;
+    }
+
+    void Reserve(size_t count) {
+        while (Capacity() < count) {
+            AddBlock();
+        }
+    }
+
+    // Destroys the elements but keeps the blocks for reuse
+    void Clear() {
+        for (; size_ > 0; --size_) {
+            (*this)[size_ - 1].~T();
+        }
+    }
+
+    void Swap(BlockArray& other) noexcept {
+        std::swap(blocks_, other.blocks_);
+        std::swap(size_, other.size_);
+    }
+
+    static T* Locate(T* const* blocks, size_t index) {
+        size_t shifted = index + FIRST_BLOCK_SIZE;
+        size_t log = FloorLog2(shifted);
+        return blocks[log - FIRST_BLOCK_SHIFT] + (shifted - (size_t{1} << log));
+    }
+
+    // Whether index is the first element of its block
+    static bool IsBlockStart(size_t index) {
+        size_t shifted = index + FIRST_BLOCK_SIZE;
+        return (shifted & (shifted - 1)) == 0;
+    }
+
+    static size_t BlockStart(size_t block) {
+        return (FIRST_BLOCK_SIZE << block) - FIRST_BLOCK_SIZE;
+    }
+
+    static size_t BlockSize(size_t block) {
+        return FIRST_BLOCK_SIZE << block;
+    }
+
+private:
+    static constexpr size_t FIRST_BLOCK_SHIFT = 3;
+    static constexpr size_t FIRST_BLOCK_SIZE = size_t{1} << FIRST_BLOCK_SHIFT;
+
+    std::vector<T*> blocks_;
+    size_t size_ = 0;
+
+    // Only allocates, elements are constructed one at a time, so no insert pays for a whole block
+    void AddBlock() {
+        blocks_.reserve(blocks_.size() + 1);
+        blocks_.push_back(std::allocator<T>().allocate(BlockSize(blocks_.size())));
+    }
+};
+
+}  // namespace hash_map_detail
+
+// Capacities are primes from a fixed table, every modulo is by a compile-time constant,
+// so the compiler replaces the division with a multiplication
+class PrimeGrowthPolicy {
+public:
+    explicit PrimeGrowthPolicy(size_t min_capacity)
+        : index_(std::lower_bound(hash_map_detail::PRIMES.begin(), hash_map_detail::PRIMES.end(), min_capacity) -
+                 hash_map_detail::PRIMES.begin()) {
+        if (index_ == hash_map_detail::PRIMES.size()) {
+            throw std::length_error("HashMap capacity is too large");
+        }
+    }
+
+    size_t Capacity() const {
+        return hash_map_detail::PRIMES[index_];
+    }
+
+    size_t NextCapacity() const {
+        return index_ + 1 < hash_map_detail::PRIMES.size() ? hash_map_detail::PRIMES[index_ + 1]
+                                                           : std::numeric_limits<size_t>::max();
+    }
+
+    size_t GetBucket(size_t hash) const {
+        return hash_map_detail::MODULO_PRIMES[index_](hash);
+    }
+
+private:
+    size_t index_;
+};
+
+// Whether objects keep their hash by default, so growing never calls the hasher again.
+// Specialize it for key types whose hash is as cheap as reading it back
+template <typename KeyType>
+struct StoreHashTrait
+    : std::bool_constant<!std::is_arithmetic_v<KeyType> && !std::is_enum_v<KeyType> && !std::is_pointer_v<KeyType>> {};
+
+namespace hash_map_detail {
+
+// A single 32-bit draw would leave most of the engine state predictable, so the whole state is seeded
+inline std::mt19937_64 MakeSeedEngine() {
+    std::random_device device;
+    std::seed_seq sequence{device(), device(), device(), device(), device(), device(), device(), device()};
+    return std::mt19937_64(sequence);
+}
+
+inline size_t RandomSeed() {
+    static thread_local std::mt19937_64 engine = MakeSeedEngine();
+    return engine();
+}
+
+}  // namespace hash_map_detail
+
+// Finalizer of MurmurHash3 over the seeded user hash, every bit of the input affects every bit of the result.
+// Identity hashes of strided or aligned keys otherwise form dense clusters of home buckets, and without
+// a per-instance seed anyone who knows the hasher can choose keys sharing one neighbourhood
+struct AvalancheHashMixer {
+    size_t operator()(size_t hash, size_t seed) const {
+        uint64_t mixed = hash ^ seed;
+        mixed ^= mixed >> 33;
+        mixed *= 0xff51afd7ed558ccdull;
+        mixed ^= mixed >> 33;
+        mixed *= 0xc4ceb9fe1a85ec53ull;
+        mixed ^= mixed >> 33;
+        return static_cast<size_t>(mixed);
+    }
+};
+
+// For hashers that already avalanche and keys that are trusted, the seed is ignored
+struct IdentityHashMixer {
+    size_t operator()(size_t hash, size_t) const {
+        return hash;
+    }
+};
+
+// The mixer applied to user hashes by default. std::hash is the identity for integers, enums and pointers,
+// and even a strong unseeded hash of strings can be flooded, so every key type is mixed.
+// Specialize it for key types that come with a strong hash and are trusted
+template <typename KeyType>
+struct HashMixerTrait {
+    using type = AvalancheHashMixer;
+};
+
+// Objects never move once inserted: references and pointers to them stay valid until the object is erased,
+// across growth, rehash, swap and moves of the map. Iterators are invalidated by any insert, and by erasing
+// the object they point to
+template <typename KeyType, typename ValueType, typename Hash = std::hash<KeyType>,
+          typename KeyEqual = std::equal_to<KeyType>, typename GrowthPolicy = PowerOfTwoGrowthPolicy,
+          bool StoreHash = StoreHashTrait<KeyType>::value, typename HashMixer = typename HashMixerTrait<KeyType>::type>
+class HashMap : private hash_map_detail::EmptyBase<KeyEqual> {
 private:
     using ObjectType = std::pair<const KeyType, ValueType>;
     using SizeType = size_t;
     using DifferenceType = ptrdiff_t;
+    using IndexType = uint32_t;
+    using HopType = uint32_t;
+    using TagType = uint8_t;
+
+    // Objects keep a mutable key, so extract and merge can move it out. Users only ever see ObjectType,
+    // which has the same layout
+    using MutableObjectType = std::pair<KeyType, ValueType>;
+
+    // Entries live in blocks of slots that never move; erased slots are kept on a free list and reused
+    struct Slot : hash_map_detail::SlotHash<StoreHash> {
+        std::optional<MutableObjectType> object_;
+        IndexType bucket_;  // Bucket referencing this slot or OVERFLOW_BUCKET, the next free slot once erased
+
+        ObjectType& Object() {
+            return *std::launder(reinterpret_cast<ObjectType*>(&*object_));
+        }
+
+        const ObjectType& Object() const {
+            return *std::launder(reinterpret_cast<const ObjectType*>(&*object_));
+        }
+    };
+
+    using SlotArray = hash_map_detail::BlockArray<Slot>;
+
+    template <bool IsConst>
+    class Iterator {
+    private:
+        using SlotPointer = std::conditional_t<IsConst, const Slot*, Slot*>;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;                              // NOLINT
+        using value_type = ObjectType;                                                    // NOLINT
+        using difference_type = DifferenceType;                                           // NOLINT
+        using pointer = std::conditional_t<IsConst, const ObjectType*, ObjectType*>;      // NOLINT
+        using reference = std::conditional_t<IsConst, const ObjectType&, ObjectType&>;    // NOLINT
+
+        Iterator() = default;
+
+        template <bool OtherConst, typename = std::enable_if_t<IsConst && !OtherConst>>
+        Iterator(const Iterator<OtherConst>& other)  // NOLINT
+            : blocks_(other.blocks_), slot_(other.slot_), index_(other.index_), end_(other.end_) {
+        }
+
+        reference operator*() const {
+            return slot_->Object();
+        }
+
+        pointer operator->() const {
+            return &slot_->Object();
+        }
+
+        Iterator& operator++() {
+            Advance();
+            SkipEmpty();
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator result = *this;
+            ++*this;
+            return result;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return index_ == other.index_;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return index_ != other.index_;
+        }
+
+    private:
+        friend class HashMap;
+        template <bool>
+        friend class Iterator;
+
+        Slot* const* blocks_ = nullptr;
+        SlotPointer slot_ = nullptr;
+        IndexType index_ = 0;
+        IndexType end_ = 0;
+
+        Iterator(Slot* const* blocks, IndexType index, IndexType end) : blocks_(blocks), index_(index), end_(end) {
+            if (index_ != end_) {
+                slot_ = SlotArray::Locate(blocks_, index_);
+            }
+            SkipEmpty();
+        }
+
+        // Consecutive slots share a block except at block starts
+        void Advance() {
+            ++index_;
+            if (index_ == end_) {
+                return;
+            }
+            if (SlotArray::IsBlockStart(index_)) {
+                slot_ = SlotArray::Locate(blocks_, index_);
+            } else {
+                ++slot_;
+            }
+        }
+
+        void SkipEmpty() {
+            while (index_ != end_ && !slot_->object_) {
+                Advance();
+            }
+        }
+    };
+
+    // Owns an object taken out of a map, so it can be moved into another map of the same type.
+    // The key is stored non-const and the value is only ever moved
+    class NodeHandle {
+    public:
+        NodeHandle() = default;
+
+        // A moved-from handle is empty, as the object has a single owner
+        NodeHandle(NodeHandle&& other) noexcept(std::is_nothrow_move_constructible_v<MutableObjectType>)
+            : object_(std::move(other.object_)) {
+            other.object_.reset();
+        }
+
+        NodeHandle& operator=(NodeHandle&& other) noexcept(std::is_nothrow_move_constructible_v<MutableObjectType> &&
+                                                           std::is_nothrow_move_assignable_v<MutableObjectType>) {
+            if (this != &other) {
+                object_ = std::move(other.object_);
+                other.object_.reset();
+            }
+            return *this;
+        }
+
+        bool empty() const {  // NOLINT
+            return !object_;
+        }
+
+        explicit operator bool() const {
+            return object_.has_value();
+        }
+
+        KeyType& key() const {  // NOLINT
+            return object_->first;
+        }
+
+        ValueType& mapped() const {  // NOLINT
+            return object_->second;
+        }
+
+    private:
+        friend class HashMap;
+
+        mutable std::optional<MutableObjectType> object_;
+
+        explicit NodeHandle(MutableObjectType&& object) : object_(std::move(object)) {
+        }
+    };
+
+    static constexpr bool NOTHROW_MOVE =
+        std::is_nothrow_move_constructible_v<Hash> && std::is_nothrow_move_constructible_v<KeyEqual> &&
+        std::is_nothrow_swappable_v<Hash> && std::is_nothrow_swappable_v<KeyEqual> &&
+        std::is_nothrow_move_constructible_v<GrowthPolicy> && std::is_nothrow_move_assignable_v<GrowthPolicy>;
+
+    template <typename H>
+    using IsTransparentLookup =
+        std::conjunction<hash_map_detail::IsTransparent<H>, hash_map_detail::IsTransparent<KeyEqual>>;
 
 public:
-    using iterator = typename std::list<ObjectType>::iterator;              // NOLINT
-    using const_iterator = typename std::list<ObjectType>::const_iterator;  // NOLINT
+    using iterator = Iterator<false>;       // NOLINT
+    using const_iterator = Iterator<true>;  // NOLINT
+    using hash_type = SizeType;             // NOLINT
+    using node_type = NodeHandle;           // NOLINT
 
-    explicit HashMap(const Hash hasher = Hash()) : neighbourhood_size_(min_neighbourhood_size_), hasher_(hasher) {
-        objects_.clear();
-        buckets_.assign(neighbourhood_size_, Bucket{});
+    struct insert_return_type {  // NOLINT
+        iterator position;
+        bool inserted = false;
+        node_type node;
+    };
+
+    explicit HashMap(const Hash hasher = Hash(), const KeyEqual key_equal = KeyEqual())
+        : KeyEqualBase(key_equal), neighbourhood_size_(MIN_NEIGHBOURHOOD_SIZE), hasher_(hasher) {
+        UpdateLoadThreshold();
     }
 
     template <typename IteratorType>
-    HashMap(IteratorType begin, IteratorType end, const Hash hasher = Hash()) : HashMap(hasher) {
+    HashMap(IteratorType begin, IteratorType end, const Hash hasher = Hash(), const KeyEqual key_equal = KeyEqual())
+        : HashMap(hasher, key_equal) {
+        if constexpr (std::is_base_of_v<std::forward_iterator_tag,
+                                        typename std::iterator_traits<IteratorType>::iterator_category>) {
+            reserve(std::distance(begin, end));
+        }
         for (; begin != end; ++begin) {
             insert(*begin);
         }
     }
 
-    HashMap(std::initializer_list<ObjectType> list, const Hash hasher = Hash())
-        : HashMap(list.begin(), list.end(), hasher) {
+    HashMap(std::initializer_list<ObjectType> list, const Hash hasher = Hash(), const KeyEqual key_equal = KeyEqual())
+        : HashMap(list.begin(), list.end(), hasher, key_equal) {
     }
 
-    HashMap(const HashMap& other) : HashMap(other.hasher_) {
-        Reallocate(other.buckets_.size(), other.neighbourhood_size_);
-        for (auto it = other.objects_.begin(); it != other.objects_.end(); ++it) {
-            insert(*it);
-        }
+    // Slots and buckets refer to each other by index, so the layout is copied as is without placing
+    // any object again. The copy shares the seed, which the layout depends on
+    HashMap(const HashMap& other)
+        : KeyEqualBase(other),
+          slots_(other.slots_),
+          free_slot_(other.free_slot_),
+          free_count_(other.free_count_),
+          table_(other.table_),
+          migration_(other.migration_ ? std::make_unique<Migration>(*other.migration_) : nullptr),
+          seed_(other.seed_),
+          reseed_capacity_(other.reseed_capacity_),
+          load_threshold_(other.load_threshold_),
+          neighbourhood_size_(other.neighbourhood_size_),
+          max_load_factor_(other.max_load_factor_),
+          incremental_growth_(other.incremental_growth_),
+          hasher_(other.hasher_) {
     }
 
-    HashMap(HashMap&& other) : HashMap() {
-        Swap(other);
+    // Moves never allocate, the moved-from map is left like a new one
+    HashMap(HashMap&& other) noexcept(NOTHROW_MOVE)
+        : KeyEqualBase(std::move(static_cast<KeyEqualBase&>(other))),
+          slots_(std::move(other.slots_)),
+          free_slot_(other.free_slot_),
+          free_count_(other.free_count_),
+          table_(std::move(other.table_)),
+          migration_(std::move(other.migration_)),
+          rebuild_count_(other.rebuild_count_),
+          seed_(other.seed_),
+          reseed_capacity_(other.reseed_capacity_),
+          load_threshold_(other.load_threshold_),
+          neighbourhood_size_(other.neighbourhood_size_),
+          max_load_factor_(other.max_load_factor_),
+          incremental_growth_(other.incremental_growth_),
+          hasher_(std::move(other.hasher_)) {
+        other.Release();
     }
 
     HashMap& operator=(const HashMap& other) & {
@@ -54,325 +581,1005 @@ public:
         Swap(map);
         return *this;
     }
-    HashMap& operator=(HashMap&& other) & {
-        clear();
-        Swap(other);
+    HashMap& operator=(HashMap&& other) & noexcept(NOTHROW_MOVE) {
+        if (this != &other) {
+            Swap(other);
+            other.Release();
+        }
         return *this;
     }
 
     SizeType size() const {  // NOLINT
-        return objects_.size();
+        return slots_.Size() - free_count_;
     }
 
     bool empty() const {  // NOLINT
-        return objects_.empty();
+        return size() == 0;
     }
 
     Hash hash_function() const {  // NOLINT
         return hasher_;
     }
 
-    iterator insert(const ObjectType& value) {  // NOLINT
-        BucketIterator it = FindObject(value.first);
-        if (it != buckets_.end()) {
-            return it->object_it_;
+    KeyEqual key_eq() const {  // NOLINT
+        return KeyEqualBase::Get();
+    }
+
+    SizeType bucket_count() const {  // NOLINT
+        return table_.Capacity();
+    }
+
+    float load_factor() const {  // NOLINT
+        return table_.Capacity() == 0 ? 0 : static_cast<float>(size()) / table_.Capacity();
+    }
+
+    float max_load_factor() const {  // NOLINT
+        return max_load_factor_;
+    }
+
+    void max_load_factor(float max_load_factor) {  // NOLINT
+        if (!(max_load_factor > 0 && max_load_factor <= 1)) {
+            throw std::invalid_argument("HashMap max load factor must be in (0, 1]");
+        }
+        max_load_factor_ = max_load_factor;
+        UpdateLoadThreshold();
+        if (size() > load_threshold_) {
+            rehash(0);
         }
-        objects_.push_front(value);
-        it = InsertObject(objects_.begin(), objects_.cbegin());
-        if (it == buckets_.end()) {
+    }
+
+    // Rebuilds the table with at least count buckets, but never fewer than the load factor allows
+    void rehash(SizeType count) {  // NOLINT
+        count = std::max({count, GetMinCapacity(size()), MIN_NEIGHBOURHOOD_SIZE});
+        if (GrowthPolicy(count).Capacity() != table_.Capacity() && !Rebuild(count, neighbourhood_size_)) {
             HandleCollision();
-            it = FindObject(value.first);
         }
-        return it->object_it_;
     }
 
-    iterator insert(ObjectType&& value) {  // NOLINT
-        BucketIterator it = FindObject(value.first);
-        if (it != buckets_.end()) {
-            return it->object_it_;
+    void reserve(SizeType count) {  // NOLINT
+        slots_.Reserve(count);
+        if (count > load_threshold_) {
+            rehash(GetMinCapacity(count));
         }
-        objects_.push_front(std::move(value));
-        it = InsertObject(objects_.begin(), objects_.cbegin());
-        if (it == buckets_.end()) {
-            HandleCollision();
-            it = FindObject(objects_.begin()->first);
+    }
+
+    bool incremental_growth() const {  // NOLINT
+        return incremental_growth_;
+    }
+
+    // When enabled, growing by load keeps the old bucket array and moves its objects
+    // a few buckets at a time on the following insert, erase and find calls
+    void incremental_growth(bool enable) {  // NOLINT
+        incremental_growth_ = enable;
+        if (!enable) {
+            MigrateBuckets(std::numeric_limits<SizeType>::max());
+        }
+    }
+
+    // Per-instance seed mixed into every user hash, replaced when flooding is detected
+    size_t hash_seed() const {  // NOLINT
+        return seed_;
+    }
+
+    // How many times the bucket array was rebuilt since construction
+    SizeType rebuild_count() const {  // NOLINT
+        return rebuild_count_;
+    }
+
+    iterator insert(const ObjectType& value) {  // NOLINT
+        return InsertValue(value, HashKey(value.first));
+    }
+
+    iterator insert(ObjectType&& value) {  // NOLINT
+        SizeType hash = HashKey(value.first);
+        return InsertValue(std::move(value), hash);
+    }
+
+    // The overloads taking a hash expect hash_function()(key), so one hash can be computed
+    // ahead of time and shared by several maps with the same hasher
+    iterator insert(const ObjectType& value, hash_type hash) {  // NOLINT
+        return InsertValue(value, hash);
+    }
+
+    iterator insert(ObjectType&& value, hash_type hash) {  // NOLINT
+        return InsertValue(std::move(value), hash);
+    }
+
+    // Builds the object in its slot, and destroys it again if the key is already present
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args) {  // NOLINT
+        MigrateBuckets(MIGRATION_STEP);
+        IndexType slot = AcquireSlot(std::forward<Args>(args)...);
+        SizeType hash = HashKey(slots_[slot].object_->first);
+        Probe probe = MakeProbe(table_, hash);
+        IndexType existing = FindObject(slots_[slot].object_->first, probe);
+        if (existing != EMPTY_SLOT) {
+            ReleaseSlot(slot);
+            return {MakeIterator(existing), false};
         }
-        return it->object_it_;
+        LinkSlot(slot, hash, probe);
+        return {MakeIterator(slot), true};
+    }
+
+    // Constructs the value from args only when the key is absent, otherwise args are left untouched
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const KeyType& key, Args&&... args) {  // NOLINT
+        return TryEmplaceKey(key, std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(KeyType&& key, Args&&... args) {  // NOLINT
+        return TryEmplaceKey(std::move(key), std::forward<Args>(args)...);
+    }
+
+    template <typename MappedArg>
+    std::pair<iterator, bool> insert_or_assign(const KeyType& key, MappedArg&& mapped) {  // NOLINT
+        return InsertOrAssignKey(key, std::forward<MappedArg>(mapped));
+    }
+
+    template <typename MappedArg>
+    std::pair<iterator, bool> insert_or_assign(KeyType&& key, MappedArg&& mapped) {  // NOLINT
+        return InsertOrAssignKey(std::move(key), std::forward<MappedArg>(mapped));
     }
 
     void erase(const KeyType& key) {  // NOLINT
-        BucketIterator it = FindObject(key);
-        if (it == buckets_.end()) {
+        EraseKey(key, HashKey(key));
+    }
+
+    // The slot remembers its bucket, so the key is neither compared nor hashed.
+    // Other iterators stay valid
+    iterator erase(const_iterator pos) {  // NOLINT
+        IndexType slot = pos.index_;
+        MigrateBuckets(MIGRATION_STEP);
+        EraseObject(slot);
+        ReleaseSlot(slot);
+        return MakeIterator(slot);
+    }
+
+    iterator erase(iterator pos) {  // NOLINT
+        return erase(const_iterator(pos));
+    }
+
+    // The key and the value are moved into the node
+    node_type extract(const_iterator pos) {  // NOLINT
+        IndexType slot = pos.index_;
+        MigrateBuckets(MIGRATION_STEP);
+        EraseObject(slot);
+        node_type node(std::move(*slots_[slot].object_));
+        ReleaseSlot(slot);
+        return node;
+    }
+
+    node_type extract(const KeyType& key) {  // NOLINT
+        const_iterator it = find(key);
+        if (it == end()) {
+            return {};
+        }
+        return extract(it);
+    }
+
+    // A node whose key is already present is handed back in the result
+    insert_return_type insert(node_type&& node) {  // NOLINT
+        if (!node) {
+            return {end(), false, {}};
+        }
+        auto [it, inserted] = TryEmplaceKey(std::move(node.object_->first), std::move(node.object_->second));
+        if (!inserted) {
+            return {it, false, std::move(node)};
+        }
+        node.object_.reset();
+        return {it, true, {}};
+    }
+
+    // Moves every object whose key is absent here out of source, duplicates stay in source.
+    // Keys are moved and keep the hash source computed for them, so nothing is hashed again
+    void merge(HashMap& source) {  // NOLINT
+        if (&source == this) {
             return;
         }
-        objects_.erase(it->object_const_it_);
-        EraseObject(it);
+        for (auto it = source.begin(); it != source.end();) {
+            MutableObjectType& object = *source.slots_[it.index_].object_;
+            if (TryEmplaceHashed(std::move(object.first), source.GetSlotHash(it.index_), std::move(object.second))
+                    .second) {
+                it = source.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void merge(HashMap&& source) {  // NOLINT
+        merge(source);
+    }
+
+    iterator erase(const_iterator first, const_iterator last) {  // NOLINT
+        while (first != last) {
+            first = erase(first);
+        }
+        return MakeIterator(last.index_);
+    }
+
+    void erase(const KeyType& key, hash_type hash) {  // NOLINT
+        EraseKey(key, hash);
+    }
+
+    // Heterogeneous erase, find and at are available when both Hash and KeyEqual are transparent
+    // and look keys up without building a KeyType
+    template <typename K, typename H = Hash, std::enable_if_t<IsTransparentLookup<H>::value, int> = 0>
+    void erase(const K& key) {  // NOLINT
+        EraseKey(key, HashKey(key));
+    }
+
+    template <typename K, typename H = Hash, std::enable_if_t<IsTransparentLookup<H>::value, int> = 0>
+    void erase(const K& key, hash_type hash) {  // NOLINT
+        EraseKey(key, hash);
     }
 
     iterator begin() {  // NOLINT
-        return objects_.begin();
+        return MakeIterator(0);
     }
 
     iterator end() {  // NOLINT
-        return objects_.end();
+        return MakeIterator(slots_.Size());
     }
 
     const_iterator begin() const {  // NOLINT
-        return objects_.cbegin();
+        return MakeIterator(0);
     }
 
     const_iterator end() const {  // NOLINT
-        return objects_.cend();
+        return MakeIterator(slots_.Size());
     }
 
     iterator find(const KeyType& key) {  // NOLINT
-        BucketIterator it = FindObject(key);
-        if (it == buckets_.end()) {
-            return end();
-        }
-        return it->object_it_;
+        return FindKey(key, HashKey(key));
     }
 
     const_iterator find(const KeyType& key) const {  // NOLINT
-        ConstBucketIterator it = FindObject(key);
-        if (it == buckets_.cend()) {
-            return end();
-        }
-        return it->object_const_it_;
+        return FindKey(key, HashKey(key));
+    }
+
+    iterator find(const KeyType& key, hash_type hash) {  // NOLINT
+        return FindKey(key, hash);
+    }
+
+    const_iterator find(const KeyType& key, hash_type hash) const {  // NOLINT
+        return FindKey(key, hash);
+    }
+
+    template <typename K, typename H = Hash, std::enable_if_t<IsTransparentLookup<H>::value, int> = 0>
+    iterator find(const K& key) {  // NOLINT
+        return FindKey(key, HashKey(key));
+    }
+
+    template <typename K, typename H = Hash, std::enable_if_t<IsTransparentLookup<H>::value, int> = 0>
+    const_iterator find(const K& key) const {  // NOLINT
+        return FindKey(key, HashKey(key));
+    }
+
+    template <typename K, typename H = Hash, std::enable_if_t<IsTransparentLookup<H>::value, int> = 0>
+    iterator find(const K& key, hash_type hash) {  // NOLINT
+        return FindKey(key, hash);
+    }
+
+    template <typename K, typename H = Hash, std::enable_if_t<IsTransparentLookup<H>::value, int> = 0>
+    const_iterator find(const K& key, hash_type hash) const {  // NOLINT
+        return FindKey(key, hash);
     }
 
     ValueType& operator[](const KeyType& key) {
-        iterator it = insert({key, ValueType{}});
-        return it->second;
+        return TryEmplaceKey(key).first->second;
     }
 
     ValueType& operator[](KeyType&& key) {
-        iterator it = insert({std::move(key), ValueType{}});
-        return it->second;
+        return TryEmplaceKey(std::move(key)).first->second;
     }
 
     const ValueType& at(const KeyType& key) const {  // NOLINT
-        ConstBucketIterator it = FindObject(key);
-        if (it == buckets_.cend()) {
-            throw std::out_of_range("404 Not found");
-        }
-        return it->object_const_it_->second;
+        return AtKey(key);
+    }
+
+    template <typename K, typename H = Hash, std::enable_if_t<IsTransparentLookup<H>::value, int> = 0>
+    const ValueType& at(const K& key) const {  // NOLINT
+        return AtKey(key);
     }
 
+    // Keeps the slot array for reuse but drops the buckets, like a new map
     void clear() {  // NOLINT
-        neighbourhood_size_ = min_neighbourhood_size_;
-        objects_.clear();
-        buckets_.assign(min_neighbourhood_size_, Bucket{});
+        neighbourhood_size_ = MIN_NEIGHBOURHOOD_SIZE;
+        slots_.Clear();
+        free_slot_ = EMPTY_SLOT;
+        free_count_ = 0;
+        table_ = Table();
+        migration_.reset();
+        reseed_capacity_ = 0;
+        UpdateLoadThreshold();
     }
 
 private:
-    static const SizeType NULL_DELTA = std::numeric_limits<SizeType>::max();
-    static const SizeType EMPTY_BUCKET = std::numeric_limits<SizeType>::max();
-    const SizeType size_modifier_ = 3;
-    const SizeType neighbourhood_modifier_ = 3;
-    const SizeType min_neighbourhood_size_ = 4;
+    using KeyEqualBase = hash_map_detail::EmptyBase<KeyEqual>;
 
-    std::list<ObjectType> objects_;
+    static constexpr IndexType EMPTY_SLOT = std::numeric_limits<IndexType>::max();
+    static constexpr IndexType OVERFLOW_BUCKET = std::numeric_limits<IndexType>::max();
+    // Neighbourhood membership is kept in a hop-information bitmap, one bit per bucket
+    static constexpr SizeType MAX_NEIGHBOURHOOD_SIZE = std::numeric_limits<HopType>::digits;
+    static constexpr SizeType NEIGHBOURHOOD_MODIFIER = 3;
+    static constexpr SizeType MIN_NEIGHBOURHOOD_SIZE = 4;
+
+    SlotArray slots_;
+    IndexType free_slot_ = EMPTY_SLOT;  // Head of the free list, which is threaded through Slot::bucket_
+    IndexType free_count_ = 0;
 
     struct Bucket {
-        iterator object_it_;
-        const_iterator object_const_it_;
-        SizeType first_delta_ = NULL_DELTA;
-        SizeType next_delta_ = NULL_DELTA;
-        SizeType prev_delta_ = NULL_DELTA;
-        SizeType object_bucket_ = EMPTY_BUCKET;
+        IndexType slot_ = EMPTY_SLOT;
+        HopType hop_info_ = 0;  // Bit i is set when bucket (this + i) holds an object whose home is this bucket
     };
 
-    using BucketIterator = typename std::vector<Bucket>::iterator;
-    using ConstBucketIterator = typename std::vector<Bucket>::const_iterator;
+    static_assert(sizeof(Bucket) <= 16, "Bucket must stay a compact metadata record");
+
+    // Objects that do not fit into their neighbourhood even at MAX_NEIGHBOURHOOD_SIZE. The table grows only
+    // once the stash holds more than limit_ objects, and only while such growth has been emptying the stash.
+    // Objects with colliding hashes are never separated
+    struct Stash {
+        struct Entry {
+            IndexType slot_;
+            SizeType mixed_hash_;  // Compared before the key, and locates the home bucket on erase
+        };
 
-    std::vector<Bucket> buckets_;
+        explicit Stash(SizeType capacity) : overflowed_(capacity) {
+        }
+
+        std::vector<Entry> entries_;
+        // Bit b is set while an object whose home is bucket b is stashed, so other misses skip the scan
+        std::vector<bool> overflowed_;
+        SizeType limit_ = MIN_STASH_SIZE;
+        bool growth_helps_ = true;
+    };
+
+    // A bucket array together with everything needed to place objects into it
+    struct Table {
+        GrowthPolicy growth_policy_;
+        std::vector<Bucket> buckets_;
+        // A fragment of the hash of the object in the same bucket, so most mismatches never touch slots_.
+        // Padded by a whole neighbourhood so it can be compared with a single unaligned vector load
+        std::unique_ptr<TagType[]> tags_;
+        std::unique_ptr<Stash> stash_;  // Allocated by the first object this table stashes
+
+        // The table of an empty map: no buckets and nothing allocated, so unused maps cost only their sizeof.
+        // Lookups stop before reading a bucket and the first insert allocates the smallest capacity
+        Table() : growth_policy_(0) {
+        }
+
+        explicit Table(SizeType capacity)
+            : growth_policy_(capacity),
+              buckets_(growth_policy_.Capacity()),
+              tags_(new TagType[growth_policy_.Capacity() + MAX_NEIGHBOURHOOD_SIZE]()) {
+        }
+
+        Table(const Table& other)
+            : growth_policy_(other.growth_policy_),
+              buckets_(other.buckets_),
+              tags_(other.tags_ ? new TagType[other.Capacity() + MAX_NEIGHBOURHOOD_SIZE] : nullptr),
+              stash_(other.stash_ ? std::make_unique<Stash>(*other.stash_) : nullptr) {
+            if (tags_) {
+                std::copy_n(other.tags_.get(), Capacity() + MAX_NEIGHBOURHOOD_SIZE, tags_.get());
+            }
+        }
+
+        Table(Table&&) = default;
+        Table& operator=(Table&&) = default;
+
+        SizeType StashSize() const {
+            return stash_ ? stash_->entries_.size() : 0;
+        }
+
+        SizeType Capacity() const {
+            return buckets_.size();
+        }
+
+        SizeType GetStartBucket(SizeType hash) const {
+            return growth_policy_.GetBucket(hash);
+        }
+
+        SizeType Wrap(SizeType bucket) const {
+            return bucket >= buckets_.size() ? bucket - buckets_.size() : bucket;
+        }
+
+        void SetTag(SizeType bucket, TagType tag) {
+            tags_[bucket] = tag;
+            // Neighbourhoods wrap around, so the head of the table is mirrored into the padding
+            if (bucket < MAX_NEIGHBOURHOOD_SIZE) {
+                tags_[buckets_.size() + bucket] = tag;
+            }
+        }
+
+        bool Contains(const SlotArray& slots, IndexType slot) const {
+            if (slots[slot].bucket_ == OVERFLOW_BUCKET) {
+                return stash_ && std::any_of(stash_->entries_.begin(), stash_->entries_.end(),
+                                             [slot](const auto& entry) { return entry.slot_ == slot; });
+            }
+            return slots[slot].bucket_ < buckets_.size() && buckets_[slots[slot].bucket_].slot_ == slot;
+        }
+    };
+
+    // Where a hash lands in a table, shared by a lookup and the placement that follows it
+    struct Probe {
+        SizeType mixed_hash_;
+        SizeType start_bucket_;
+    };
+
+    static constexpr SizeType MIN_STASH_SIZE = 16;
+    static constexpr SizeType MIGRATION_STEP = 32;  // Old buckets moved per operation while growing incrementally
+
+    Table table_;
+    // The table being moved into table_ incrementally. Growth is opt-in, so it is kept out of line
+    struct Migration {
+        Table old_table_;
+        SizeType cursor_ = 0;  // First bucket of old_table_ that has not been moved yet
+    };
+
+    std::unique_ptr<Migration> migration_;
+
+    SizeType rebuild_count_ = 0;
+
+    static constexpr float FLOOD_LOAD_FACTOR = 0.25;  // Below it a full neighbourhood is treated as flooding
+    SizeType seed_ = hash_map_detail::RandomSeed();
+    SizeType reseed_capacity_ = 0;  // Capacity of the last reseed, so flooding is handled once per capacity
+
+    static constexpr float DEFAULT_MAX_LOAD_FACTOR = 0.8;
+    SizeType load_threshold_ = 0;  // Largest size allowed by max_load_factor_ at the current capacity
 
     SizeType neighbourhood_size_;  // Вряд ли станет больше 36, а если станет, то никакая таблица не прожует
 
+    // The small members share the last word
+    float max_load_factor_ = DEFAULT_MAX_LOAD_FACTOR;
+    bool incremental_growth_ = false;
     Hash hasher_;
 
-    void HandleCollision() {
+    static SizeType CountTrailingZeros(HopType hop) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctz(hop);
+#else
+        SizeType count = 0;
+        for (; !(hop & 1); hop >>= 1) {
+            ++count;
+        }
+        return count;
+#endif
+    }
+
+    // Narrows hop down to the buckets whose tag equals tag
+    static HopType MatchTags(const TagType* tags, TagType tag, HopType hop) {
+#if defined(HASH_MAP_USE_AVX2)
+        __m256i group = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(tags));
+        HopType mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(group, _mm256_set1_epi8(tag)));
+        return hop & mask;
+#elif defined(HASH_MAP_USE_SSE2)
+        __m128i pattern = _mm_set1_epi8(tag);
+        __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tags));
+        HopType mask = static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(low, pattern)));
+        if (hop >> 16) {
+            __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tags + 16));
+            mask |= static_cast<HopType>(_mm_movemask_epi8(_mm_cmpeq_epi8(high, pattern))) << 16;
+        }
+        return hop & mask;
+#else
+        HopType result = 0;
+        for (; hop != 0; hop &= hop - 1) {
+            SizeType offset = CountTrailingZeros(hop);
+            if (tags[offset] == tag) {
+                result |= HopType{1} << offset;
+            }
+        }
+        return result;
+#endif
+    }
+
+    // slot is the object that failed to fit, or EMPTY_SLOT when the whole table has to be rebuilt
+    void HandleCollision(IndexType slot = EMPTY_SLOT) {
+        if (slot != EMPTY_SLOT && size() <= load_threshold_ &&
+            (GrowNeighbourhood(slot) || Reseed() || StashObject(table_, slot))) {
+            return;
+        }
+        // Growing for a full stash has to at least halve it, otherwise this table keeps stashing
+        // until the load alone makes it grow
+        bool stash_full = slot != EMPTY_SLOT && size() <= load_threshold_;
+        SizeType stashed = table_.StashSize() + 1;
         try {
             bool handle = false;
-            if (objects_.size() >= buckets_.size()) {
-                handle = Reallocate(buckets_.size() * size_modifier_, neighbourhood_size_);
+            if (size() > load_threshold_) {
+                handle = Reallocate(table_.growth_policy_.NextCapacity(), neighbourhood_size_);
             }
             while (!handle) {
-                handle = Reallocate((neighbourhood_size_ * neighbourhood_modifier_ >= buckets_.size() ||
-                                             objects_.size() >= buckets_.size()
-                                         ? buckets_.size() * size_modifier_
-                                         : buckets_.size()),
-                                    neighbourhood_size_ * neighbourhood_modifier_);
+                SizeType new_neighbourhood_size =
+                    std::min(neighbourhood_size_ * NEIGHBOURHOOD_MODIFIER, MAX_NEIGHBOURHOOD_SIZE);
+                handle = Reallocate((new_neighbourhood_size >= table_.Capacity() || size() > load_threshold_ ||
+                                             new_neighbourhood_size == neighbourhood_size_
+                                         ? table_.growth_policy_.NextCapacity()
+                                         : table_.Capacity()),
+                                    new_neighbourhood_size);
             }
         } catch (const std::bad_alloc& e) {
             throw e;
         }
+        if (stash_full && table_.stash_) {
+            table_.stash_->growth_helps_ = table_.StashSize() * 2 <= stashed;
+        }
+    }
+
+    // A larger neighbourhood keeps every placement valid, so only the failed object is retried
+    bool GrowNeighbourhood(IndexType slot) {
+        while (neighbourhood_size_ < MAX_NEIGHBOURHOOD_SIZE) {
+            SizeType new_neighbourhood_size =
+                std::min(neighbourhood_size_ * NEIGHBOURHOOD_MODIFIER, MAX_NEIGHBOURHOOD_SIZE);
+            if (new_neighbourhood_size >= table_.Capacity()) {
+                return false;
+            }
+            neighbourhood_size_ = new_neighbourhood_size;
+            if (InsertObject(table_, slot, GetSlotHash(slot))) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // A full neighbourhood at low load means the keys were chosen against the seed, so the table
+    // is rebuilt once per capacity with a new one before the object is stashed
+    bool Reseed() {
+        if (neighbourhood_size_ < MAX_NEIGHBOURHOOD_SIZE || size() >= table_.Capacity() * FLOOD_LOAD_FACTOR ||
+            reseed_capacity_ == table_.Capacity()) {
+            return false;
+        }
+        seed_ = hash_map_detail::RandomSeed();
+        reseed_capacity_ = table_.Capacity();
+        // A new seed can't separate equal hashes, so a stash that growth failed to shrink stays final
+        bool stash_growth_helps = !table_.stash_ || table_.stash_->growth_helps_;
+        if (!Rebuild(table_.Capacity(), neighbourhood_size_)) {
+            return false;
+        }
+        if (table_.stash_) {
+            table_.stash_->growth_helps_ = stash_growth_helps;
+        }
+        return true;
+    }
+
+    // Rebuilds stash whatever growth could not separate, the limit only bounds further inserts
+    bool StashObject(Table& table, IndexType slot, bool rebuilding = false) {
+        if (neighbourhood_size_ < MAX_NEIGHBOURHOOD_SIZE) {
+            return false;
+        }
+        if (!table.stash_) {
+            table.stash_ = std::make_unique<Stash>(table.Capacity());
+        } else if (!rebuilding && table.StashSize() >= table.stash_->limit_ && table.stash_->growth_helps_) {
+            return false;
+        }
+        SizeType mixed_hash = MixHash(GetSlotHash(slot));
+        table.stash_->entries_.push_back({slot, mixed_hash});
+        table.stash_->overflowed_[table.GetStartBucket(mixed_hash)] = true;
+        slots_[slot].bucket_ = OVERFLOW_BUCKET;
+        return true;
     }
 
     bool Reallocate(SizeType new_capacity, SizeType new_neighbourhood_size) {
-        if (new_capacity <= buckets_.size() && new_neighbourhood_size <= neighbourhood_size_) {
+        if (new_capacity <= table_.Capacity() && new_neighbourhood_size <= neighbourhood_size_) {
             return false;
         }
+        return Rebuild(new_capacity, new_neighbourhood_size);
+    }
+
+    bool Rebuild(SizeType new_capacity, SizeType new_neighbourhood_size) {
+        if (new_capacity >= OVERFLOW_BUCKET) {
+            throw std::length_error("HashMap bucket array is full");
+        }
+        ++rebuild_count_;
         try {
-            buckets_.assign(new_capacity, Bucket{});
+            table_ = Table(new_capacity);
         } catch (const std::bad_alloc& e) {
             throw e;
         }
+        migration_.reset();
+        UpdateLoadThreshold();
         neighbourhood_size_ = new_neighbourhood_size;
-        iterator it = objects_.begin();
-        const_iterator const_it = objects_.cbegin();
-        for (; it != objects_.end() && const_it != objects_.cend(); ++it, ++const_it) {
-            BucketIterator bucket_it = InsertObject(it, const_it);
-            if (bucket_it == buckets_.end()) {
+        for (IndexType slot = 0; slot < slots_.Size(); ++slot) {
+            if (slots_[slot].object_ && !InsertObject(table_, slot, GetSlotHash(slot)) &&
+                !StashObject(table_, slot, true)) {
                 return false;
             }
         }
+        if (table_.stash_) {
+            table_.stash_->limit_ = std::max(MIN_STASH_SIZE, table_.StashSize() * 2);
+        }
         return true;
     }
 
-    BucketIterator GetStartBucket(const KeyType& key) {
-        return buckets_.begin() + hasher_(key) % buckets_.size();
-    }
-
-    ConstBucketIterator GetStartBucket(const KeyType& key) const {
-        return buckets_.cbegin() + hasher_(key) % buckets_.size();
-    }
-
-    BucketIterator InsertObject(iterator object_it, const_iterator object_const_it) {
-        BucketIterator start_bucket = GetStartBucket(object_const_it->first);
-        BucketIterator free_bucket = start_bucket;
-        while (free_bucket != buckets_.end() && free_bucket->object_bucket_ != EMPTY_BUCKET) {
-            ++free_bucket;
+    void StartMigration() {
+        MigrateBuckets(std::numeric_limits<SizeType>::max());
+        if (table_.growth_policy_.NextCapacity() >= OVERFLOW_BUCKET) {
+            throw std::length_error("HashMap bucket array is full");
         }
-        if (free_bucket == buckets_.end()) {
-            return buckets_.end();
+        ++rebuild_count_;
+        Table table(table_.growth_policy_.NextCapacity());
+        if (table_.stash_) {
+            table.stash_ = std::make_unique<Stash>(table.Capacity());
+            table.stash_->limit_ = table_.stash_->limit_;
         }
-        while (neighbourhood_size_ <= static_cast<SizeType>(free_bucket - start_bucket)) {
-            BucketIterator fit_bucket = free_bucket;
-            while (fit_bucket != buckets_.begin() &&
-                   neighbourhood_size_ > static_cast<SizeType>(free_bucket - fit_bucket) + 1) {
-                if (neighbourhood_size_ >
-                    static_cast<SizeType>(free_bucket - (buckets_.begin() + (fit_bucket - 1)->object_bucket_))) {
-                    break;
+        migration_ = std::make_unique<Migration>(Migration{std::move(table_)});
+        table_ = std::move(table);
+        UpdateLoadThreshold();
+    }
+
+    // Moves the objects of up to count old buckets into table_
+    void MigrateBuckets(SizeType count) {
+        for (; migration_ && count > 0; --count) {
+            Table& old_table = migration_->old_table_;
+            if (migration_->cursor_ == old_table.Capacity()) {
+                std::unique_ptr<Stash> stash = std::move(old_table.stash_);
+                migration_.reset();
+                if (!stash) {
+                    return;
                 }
-                --fit_bucket;
-            }
-            if (fit_bucket == buckets_.begin() ||
-                static_cast<SizeType>(free_bucket - fit_bucket) + 1 >= neighbourhood_size_) {
-                return buckets_.end();
-            }
-            --fit_bucket;
-            if (fit_bucket->prev_delta_ != NULL_DELTA) {
-                (fit_bucket - fit_bucket->prev_delta_)->next_delta_ += free_bucket - fit_bucket;
-                fit_bucket->prev_delta_ += free_bucket - fit_bucket;
-                std::swap(fit_bucket->prev_delta_, free_bucket->prev_delta_);
+                for (const auto& [slot, mixed_hash] : stash->entries_) {
+                    if (!InsertObject(table_, slot, Probe{mixed_hash, table_.GetStartBucket(mixed_hash)}) &&
+                        !StashObject(table_, slot)) {
+                        // Rebuilding places every object, including the rest of the old overflow
+                        HandleCollision();
+                        break;
+                    }
+                }
+                return;
             }
-            if (fit_bucket->next_delta_ != NULL_DELTA) {
-                (fit_bucket + fit_bucket->next_delta_)->prev_delta_ -= free_bucket - fit_bucket;
-                fit_bucket->next_delta_ -= free_bucket - fit_bucket;
-                std::swap(fit_bucket->next_delta_, free_bucket->next_delta_);
+            IndexType slot = old_table.buckets_[migration_->cursor_++].slot_;
+            if (slot == EMPTY_SLOT) {
+                continue;
             }
-            if (fit_bucket == buckets_.begin() + fit_bucket->object_bucket_ +
-                                  (buckets_.begin() + fit_bucket->object_bucket_)->first_delta_) {
-                (buckets_.begin() + fit_bucket->object_bucket_)->first_delta_ =
-                    free_bucket - (buckets_.begin() + fit_bucket->object_bucket_);
+            EraseObject(old_table, slot);
+            if (!InsertObject(table_, slot, GetSlotHash(slot))) {
+                HandleCollision(slot);
             }
-            std::swap(fit_bucket->object_it_, free_bucket->object_it_);
-            std::swap(fit_bucket->object_const_it_, free_bucket->object_const_it_);
-            std::swap(fit_bucket->object_bucket_, free_bucket->object_bucket_);
-            free_bucket = fit_bucket;
-        }
-        if (free_bucket < start_bucket) {
-            return buckets_.end();
-        }
-        free_bucket->object_it_ = object_it;
-        free_bucket->object_const_it_ = object_const_it;
-        free_bucket->object_bucket_ = start_bucket - buckets_.begin();
-        BucketIterator previous_bucket = free_bucket;
-        while (previous_bucket != start_bucket &&
-               (previous_bucket - 1)->object_bucket_ != free_bucket->object_bucket_) {
-            --previous_bucket;
-        }
-        if (previous_bucket != start_bucket) {
-            --previous_bucket;
-            if (previous_bucket->next_delta_ != NULL_DELTA) {
-                BucketIterator next_bucket = previous_bucket + previous_bucket->next_delta_;
-                next_bucket->prev_delta_ = next_bucket - free_bucket;
-                free_bucket->next_delta_ = next_bucket - free_bucket;
+        }
+    }
+
+    void UpdateLoadThreshold() {
+        load_threshold_ = table_.Capacity() * max_load_factor_;
+    }
+
+    SizeType GetMinCapacity(SizeType size) const {
+        return std::ceil(size / max_load_factor_);
+    }
+
+    // Constructs an object in a free slot, it is not reachable by lookups until LinkSlot
+    template <typename... Args>
+    IndexType AcquireSlot(Args&&... args) {
+        if (free_slot_ == EMPTY_SLOT) {
+            if (slots_.Size() >= EMPTY_SLOT) {
+                throw std::length_error("HashMap slot array is full");
             }
-            previous_bucket->next_delta_ = free_bucket - previous_bucket;
-            free_bucket->prev_delta_ = free_bucket - previous_bucket;
+            // Growing never moves a slot, so arguments referring into the map, as in mp[mp[key]], stay valid
+            slots_.EmplaceBack();
+            ReleaseSlot(slots_.Size() - 1);
+        }
+        IndexType slot = free_slot_;
+        slots_[slot].object_.emplace(std::forward<Args>(args)...);
+        free_slot_ = slots_[slot].bucket_;
+        --free_count_;
+        return slot;
+    }
+
+    // probe is the one of the failed lookup, so placing the object does not hash or mix again
+    void LinkSlot(IndexType slot, SizeType hash, Probe probe) {
+        if constexpr (StoreHash) {
+            slots_[slot].hash_ = hash;
+        }
+        if (table_.Capacity() == 0) {
+            // The first object of an empty map allocates the smallest table, there is nothing to rebuild
+            table_ = Table(MIN_NEIGHBOURHOOD_SIZE);
+            UpdateLoadThreshold();
+            probe.start_bucket_ = table_.GetStartBucket(probe.mixed_hash_);
+        } else if (size() > load_threshold_ && incremental_growth_) {
+            StartMigration();
+            probe.start_bucket_ = table_.GetStartBucket(probe.mixed_hash_);
+        }
+        if (size() > load_threshold_ || !InsertObject(table_, slot, probe)) {
+            HandleCollision(slot);
+        }
+    }
+
+    void ReleaseSlot(IndexType slot) {
+        slots_[slot].object_.reset();
+        slots_[slot].bucket_ = free_slot_;
+        free_slot_ = slot;
+        ++free_count_;
+    }
+
+    iterator MakeIterator(IndexType slot) {
+        return iterator(slots_.Blocks(), slot, slots_.Size());
+    }
+
+    const_iterator MakeIterator(IndexType slot) const {
+        return const_iterator(slots_.Blocks(), slot, slots_.Size());
+    }
+
+    template <typename ObjectArg>
+    iterator InsertValue(ObjectArg&& value, SizeType hash) {
+        MigrateBuckets(MIGRATION_STEP);
+        Probe probe = MakeProbe(table_, hash);
+        IndexType slot = FindObject(value.first, probe);
+        if (slot != EMPTY_SLOT) {
+            return MakeIterator(slot);
+        }
+        slot = AcquireSlot(std::forward<ObjectArg>(value));
+        LinkSlot(slot, hash, probe);
+        return MakeIterator(slot);
+    }
+
+    template <typename K, typename... Args>
+    std::pair<iterator, bool> TryEmplaceKey(K&& key, Args&&... args) {
+        SizeType hash = HashKey(key);
+        return TryEmplaceHashed(std::forward<K>(key), hash, std::forward<Args>(args)...);
+    }
+
+    // key and args are only consumed when the key is absent
+    template <typename K, typename... Args>
+    std::pair<iterator, bool> TryEmplaceHashed(K&& key, SizeType hash, Args&&... args) {
+        MigrateBuckets(MIGRATION_STEP);
+        Probe probe = MakeProbe(table_, hash);
+        IndexType slot = FindObject(key, probe);
+        if (slot != EMPTY_SLOT) {
+            return {MakeIterator(slot), false};
+        }
+        slot = AcquireSlot(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+                           std::forward_as_tuple(std::forward<Args>(args)...));
+        LinkSlot(slot, hash, probe);
+        return {MakeIterator(slot), true};
+    }
+
+    template <typename K, typename MappedArg>
+    std::pair<iterator, bool> InsertOrAssignKey(K&& key, MappedArg&& mapped) {
+        // mapped is only consumed when the key is absent
+        auto [it, inserted] = TryEmplaceKey(std::forward<K>(key), std::forward<MappedArg>(mapped));
+        if (!inserted) {
+            it->second = std::forward<MappedArg>(mapped);
+        }
+        return {it, inserted};
+    }
+
+    template <typename K>
+    iterator FindKey(const K& key, SizeType hash) {
+        MigrateBuckets(MIGRATION_STEP);
+        IndexType slot = FindObject(key, hash);
+        if (slot == EMPTY_SLOT) {
+            return end();
+        }
+        return MakeIterator(slot);
+    }
+
+    template <typename K>
+    const_iterator FindKey(const K& key, SizeType hash) const {
+        IndexType slot = FindObject(key, hash);
+        if (slot == EMPTY_SLOT) {
+            return end();
+        }
+        return MakeIterator(slot);
+    }
+
+    template <typename K>
+    const ValueType& AtKey(const K& key) const {
+        IndexType slot = FindObject(key, HashKey(key));
+        if (slot == EMPTY_SLOT) {
+            throw std::out_of_range("404 Not found");
+        }
+        return slots_[slot].object_->second;
+    }
+
+    template <typename K>
+    void EraseKey(const K& key, SizeType hash) {
+        MigrateBuckets(MIGRATION_STEP);
+        IndexType slot = FindObject(key, hash);
+        if (slot == EMPTY_SLOT) {
+            return;
+        }
+        EraseObject(slot);
+        ReleaseSlot(slot);
+    }
+
+    template <typename K>
+    SizeType HashKey(const K& key) const {
+        return hasher_(key);
+    }
+
+    // Objects keep and pass around the user hash, the seeded mix only picks buckets and tags
+    SizeType MixHash(SizeType hash) const {
+        return HashMixer()(hash, seed_);
+    }
+
+    SizeType GetSlotHash(IndexType slot) const {
+        if constexpr (StoreHash) {
+            return slots_[slot].hash_;
         } else {
-            if (start_bucket->first_delta_ != NULL_DELTA) {
-                BucketIterator next_bucket = start_bucket + start_bucket->first_delta_;
-                next_bucket->prev_delta_ = next_bucket - free_bucket;
-                free_bucket->next_delta_ = next_bucket - free_bucket;
-            }
-            start_bucket->first_delta_ = free_bucket - start_bucket;
+            return HashKey(slots_[slot].object_->first);
         }
-        return free_bucket;
     }
 
-    BucketIterator FindObject(const KeyType& key) {
-        BucketIterator start_bucket = GetStartBucket(key);
-        if (start_bucket->first_delta_ == NULL_DELTA) {
-            return buckets_.end();
+    static TagType GetTag(SizeType hash) {
+        // Fold the whole hash, the low bits alone are shared by every object of a neighbourhood
+        hash ^= hash >> 32;
+        hash ^= hash >> 16;
+        hash ^= hash >> 8;
+        return static_cast<TagType>(hash);
+    }
+
+    void PlaceObject(Table& table, SizeType start_bucket, SizeType offset, IndexType slot, TagType tag) {
+        SizeType bucket = table.Wrap(start_bucket + offset);
+        table.buckets_[start_bucket].hop_info_ |= HopType{1} << offset;
+        table.buckets_[bucket].slot_ = slot;
+        table.SetTag(bucket, tag);
+        slots_[slot].bucket_ = bucket;
+    }
+
+    Probe MakeProbe(const Table& table, SizeType hash) const {
+        SizeType mixed_hash = MixHash(hash);
+        return {mixed_hash, table.GetStartBucket(mixed_hash)};
+    }
+
+    bool InsertObject(Table& table, IndexType slot, SizeType hash) {
+        return InsertObject(table, slot, MakeProbe(table, hash));
+    }
+
+    bool InsertObject(Table& table, IndexType slot, const Probe& probe) {
+        SizeType capacity = table.Capacity();
+        SizeType neighbourhood_size = std::min(neighbourhood_size_, capacity);
+        SizeType start_bucket = probe.start_bucket_;
+        SizeType distance = 0;
+        while (distance < capacity && table.buckets_[table.Wrap(start_bucket + distance)].slot_ != EMPTY_SLOT) {
+            ++distance;
         }
-        start_bucket += start_bucket->first_delta_;
-        while (!(start_bucket->object_const_it_->first == key) && start_bucket->next_delta_ != NULL_DELTA) {
-            start_bucket += start_bucket->next_delta_;
+        while (distance < capacity && distance >= neighbourhood_size) {
+            // Look for the farthest home bucket whose neighbourhood covers the free bucket and owns an object before it
+            SizeType free_bucket = table.Wrap(start_bucket + distance);
+            SizeType back = neighbourhood_size - 1;
+            for (; back > 0; --back) {
+                SizeType fit_bucket = table.Wrap(free_bucket + capacity - back);
+                HopType hop = table.buckets_[fit_bucket].hop_info_ & ((HopType{1} << back) - 1);
+                if (hop != 0) {
+                    SizeType offset = CountTrailingZeros(hop);
+                    SizeType moved_bucket = table.Wrap(fit_bucket + offset);
+                    table.buckets_[fit_bucket].hop_info_ &= ~(HopType{1} << offset);
+                    PlaceObject(table, fit_bucket, back, table.buckets_[moved_bucket].slot_, table.tags_[moved_bucket]);
+                    table.buckets_[moved_bucket].slot_ = EMPTY_SLOT;
+                    distance -= back - offset;
+                    break;
+                }
+            }
+            if (back == 0) {
+                distance = capacity;
+            }
         }
-        if (!(start_bucket->object_const_it_->first == key)) {
-            return buckets_.end();
+        if (distance < capacity) {
+            PlaceObject(table, start_bucket, distance, slot, GetTag(probe.mixed_hash_));
+            return true;
         }
-        return start_bucket;
+        return false;
     }
 
-    ConstBucketIterator FindObject(const KeyType& key) const {
-        ConstBucketIterator start_bucket = GetStartBucket(key);
-        if (start_bucket->first_delta_ == NULL_DELTA) {
-            return buckets_.cend();
+    template <typename K>
+    IndexType FindObject(const Table& table, const K& key, const Probe& probe) const {
+        if (table.Capacity() == 0) {  // An empty map has not allocated any bucket yet
+            return EMPTY_SLOT;
         }
-        start_bucket += start_bucket->first_delta_;
-        while (!(start_bucket->object_const_it_->first == key) && start_bucket->next_delta_ != NULL_DELTA) {
-            start_bucket += start_bucket->next_delta_;
+        SizeType start_bucket = probe.start_bucket_;
+        HopType hop = table.buckets_[start_bucket].hop_info_;
+        if (hop != 0) {
+            hop = MatchTags(table.tags_.get() + start_bucket, GetTag(probe.mixed_hash_), hop);
         }
-        if (!(start_bucket->object_const_it_->first == key)) {
-            return buckets_.cend();
+        for (; hop != 0; hop &= hop - 1) {
+            IndexType slot = table.buckets_[table.Wrap(start_bucket + CountTrailingZeros(hop))].slot_;
+            if (KeyEqualBase::Get()(slots_[slot].object_->first, key)) {
+                return slot;
+            }
         }
-        return start_bucket;
+        return table.stash_ && table.stash_->overflowed_[start_bucket] ? FindStashed(table, key, probe) : EMPTY_SLOT;
     }
 
-    void EraseObject(BucketIterator object_bucket) {
-        if (object_bucket->prev_delta_ != NULL_DELTA) {
-            BucketIterator previous_bucket = object_bucket - object_bucket->prev_delta_;
-            if (object_bucket->next_delta_ != NULL_DELTA) {
-                BucketIterator next_bucket = object_bucket + object_bucket->next_delta_;
-                previous_bucket->next_delta_ = next_bucket - previous_bucket;
-                next_bucket->prev_delta_ = next_bucket - previous_bucket;
-            } else {
-                previous_bucket->next_delta_ = NULL_DELTA;
+    template <typename K>
+    IndexType FindStashed(const Table& table, const K& key, const Probe& probe) const {
+        for (const auto& [slot, mixed_hash] : table.stash_->entries_) {
+            if (mixed_hash == probe.mixed_hash_ && KeyEqualBase::Get()(slots_[slot].object_->first, key)) {
+                return slot;
             }
-        } else {
-            BucketIterator start_bucket = buckets_.begin() + object_bucket->object_bucket_;
-            if (object_bucket->next_delta_ != NULL_DELTA) {
-                BucketIterator next_bucket = object_bucket + object_bucket->next_delta_;
-                start_bucket->first_delta_ = next_bucket - start_bucket;
-                next_bucket->prev_delta_ = NULL_DELTA;
-            } else {
-                start_bucket->first_delta_ = NULL_DELTA;
+        }
+        return EMPTY_SLOT;
+    }
+
+    template <typename K>
+    IndexType FindObject(const K& key, SizeType hash) const {
+        return FindObject(key, MakeProbe(table_, hash));
+    }
+
+    // probe is taken for table_, only the start bucket is recomputed for the old table
+    template <typename K>
+    IndexType FindObject(const K& key, const Probe& probe) const {
+        IndexType slot = FindObject(table_, key, probe);
+        if (slot == EMPTY_SLOT && migration_) {
+            const Table& old_table = migration_->old_table_;
+            slot = FindObject(old_table, key, Probe{probe.mixed_hash_, old_table.GetStartBucket(probe.mixed_hash_)});
+        }
+        return slot;
+    }
+
+    // Only the object in the slot's bucket can be referenced by a hop bit at that distance,
+    // so the home bucket is found without hashing the key again
+    void EraseObject(Table& table, IndexType slot) {
+        if (slots_[slot].bucket_ == OVERFLOW_BUCKET) {
+            auto& entries = table.stash_->entries_;
+            auto entry = std::find_if(entries.begin(), entries.end(), [slot](const auto& e) { return e.slot_ == slot; });
+            SizeType start_bucket = table.GetStartBucket(entry->mixed_hash_);
+            *entry = entries.back();
+            entries.pop_back();
+            table.stash_->overflowed_[start_bucket] =
+                std::any_of(entries.begin(), entries.end(),
+                            [&](const auto& e) { return table.GetStartBucket(e.mixed_hash_) == start_bucket; });
+            return;
+        }
+        SizeType capacity = table.Capacity();
+        SizeType neighbourhood_size = std::min(neighbourhood_size_, capacity);
+        SizeType bucket = slots_[slot].bucket_;
+        for (SizeType offset = 0; offset < neighbourhood_size; ++offset) {
+            SizeType start_bucket = table.Wrap(bucket + capacity - offset);
+            if (table.buckets_[start_bucket].hop_info_ & (HopType{1} << offset)) {
+                table.buckets_[start_bucket].hop_info_ &= ~(HopType{1} << offset);
+                break;
             }
         }
-        object_bucket->next_delta_ = NULL_DELTA;
-        object_bucket->prev_delta_ = NULL_DELTA;
-        object_bucket->object_bucket_ = EMPTY_BUCKET;
+        table.buckets_[bucket].slot_ = EMPTY_SLOT;
+    }
+
+    void EraseObject(IndexType slot) {
+        bool migrating = migration_ && migration_->old_table_.Contains(slots_, slot);
+        EraseObject(migrating ? migration_->old_table_ : table_, slot);
+    }
+
+    // Frees everything without allocating
+    void Release() noexcept {
+        SlotArray().Swap(slots_);
+        free_slot_ = EMPTY_SLOT;
+        free_count_ = 0;
+        table_ = Table();
+        migration_.reset();
+        reseed_capacity_ = 0;
+        neighbourhood_size_ = MIN_NEIGHBOURHOOD_SIZE;
+        load_threshold_ = 0;
     }
 
     void Swap(HashMap& other) {
-        std::swap(objects_, other.objects_);
-        std::swap(buckets_, other.buckets_);
+        slots_.Swap(other.slots_);
+        std::swap(free_slot_, other.free_slot_);
+        std::swap(free_count_, other.free_count_);
+        std::swap(table_, other.table_);
+        std::swap(migration_, other.migration_);
+        std::swap(incremental_growth_, other.incremental_growth_);
+        std::swap(rebuild_count_, other.rebuild_count_);
+        std::swap(max_load_factor_, other.max_load_factor_);
+        std::swap(load_threshold_, other.load_threshold_);
         std::swap(neighbourhood_size_, other.neighbourhood_size_);
         std::swap(hasher_, other.hasher_);
+        std::swap(static_cast<KeyEqualBase&>(*this), static_cast<KeyEqualBase&>(other));
+        std::swap(seed_, other.seed_);
+        std::swap(reseed_capacity_, other.reseed_capacity_);
+    }
+};
+
+// Erases every object satisfying pred in one pass over the slot array
+template <typename KeyType, typename ValueType, typename Hash, typename KeyEqual, typename GrowthPolicy, bool StoreHash,
+          typename HashMixer, typename Predicate>
+size_t erase_if(HashMap<KeyType, ValueType, Hash, KeyEqual, GrowthPolicy, StoreHash, HashMixer>& map,  // NOLINT
+                Predicate pred) {
+    size_t old_size = map.size();
+    for (auto it = map.begin(); it != map.end();) {
+        if (pred(*it)) {
+            it = map.erase(it);
+        } else {
+            ++it;
+        }
     }
-};
\ No newline at end of file
+    return old_size - map.size();
+}
\ No newline at end of file
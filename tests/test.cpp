@@ -1,9 +1,12 @@
 #include <algorithm>
 #include <catch.hpp>
+#include <chrono>
 #include <functional>
 #include <iostream>
 #include <map>
 #include <random>
+#include <string>
+#include <string_view>
 #include <vector>
 
 #include "hash_map.hpp"
@@ -44,6 +47,49 @@ struct StrangeInt {
 
 int StrangeInt::counter;
 
+struct CountedValue {
+    int x = 0;
+    static int constructed;
+    static int copied;
+
+    CountedValue() {
+        ++constructed;
+    }
+
+    explicit CountedValue(int x) : x(x) {
+        ++constructed;
+    }
+
+    CountedValue(const CountedValue& rs) : x(rs.x) {
+        ++copied;
+    }
+
+    CountedValue& operator=(const CountedValue& rs) = default;
+
+    static void init() {
+        constructed = 0;
+        copied = 0;
+    }
+};
+
+int CountedValue::constructed;
+int CountedValue::copied;
+
+struct CountingHasher {
+    int* calls;
+    size_t operator()(const std::string& s) const {
+        ++*calls;
+        return std::hash<std::string>()(s);
+    }
+};
+
+// Only four distinct hashes, so the keys crowd a few neighbourhoods
+struct ClusterHasher {
+    size_t operator()(int x) const {
+        return x % 4;
+    }
+};
+
 namespace std {
 template <>
 struct hash<StrangeInt> {
@@ -314,4 +360,770 @@ TEST_CASE("Check workability") {
             REQUIRE(mp2.at(v[i]) == it2->second);
         }
     }
-}
\ No newline at end of file
+}
+TEST_CASE("Check slot storage") {
+    HashMap<int, int> mp;
+    for (int i = 0; i < 100; ++i) {
+        mp[i] = i;
+    }
+    for (int i = 0; i < 100; i += 2) {
+        mp.erase(i);
+    }
+    REQUIRE(mp.size() == 50);
+    int count = 0;
+    for (auto it = mp.begin(); it != mp.end(); ++it) {
+        REQUIRE(it->first % 2 == 1);
+        REQUIRE(it->second == it->first);
+        ++count;
+    }
+    REQUIRE(count == 50);
+    const int* address = &mp.find(1)->second;
+    for (int i = 100; i < 150; ++i) {
+        mp[i] = i;
+    }
+    REQUIRE(mp.size() == 100);
+    REQUIRE(&mp.find(1)->second == address);
+    HashMap<int, int>::const_iterator it = mp.find(149);
+    REQUIRE(it->second == 149);
+
+    // Growing the slot array neither moves nor copies the objects already stored
+    int& reference = mp[1];
+    for (int i = 150; i < 100000; ++i) {
+        mp[i] = i;
+    }
+    REQUIRE(&reference == address);
+    REQUIRE(reference == 1);
+    CountedValue::init();
+    HashMap<std::string, CountedValue> values;
+    for (int i = 0; i < 100000; ++i) {
+        values[std::to_string(i)].x = i;
+    }
+    REQUIRE(CountedValue::constructed == 100000);
+    REQUIRE(CountedValue::copied == 0);
+}
+
+TEST_CASE("Check colliding erase") {
+    HashMap<int, int, std::function<size_t(int)>> mp(stupid_hash);
+    for (int i = 0; i < 100; ++i) {
+        mp[i] = i;
+    }
+    for (int i = 0; i < 100; i += 3) {
+        mp.erase(i);
+    }
+    for (int i = 0; i < 100; ++i) {
+        REQUIRE((mp.find(i) == mp.end()) == (i % 3 == 0));
+    }
+    for (int i = 0; i < 100; i += 3) {
+        mp[i] = -i;
+    }
+    REQUIRE(mp.size() == 100);
+    for (int i = 0; i < 100; ++i) {
+        REQUIRE(mp.at(i) == (i % 3 == 0 ? -i : i));
+    }
+}
+
+TEST_CASE("Check growth policies") {
+    HashMap<int, int, std::hash<int>, std::equal_to<int>, PrimeGrowthPolicy> prime_map;
+    HashMap<int, int, std::hash<int>, std::equal_to<int>, PowerOfTwoGrowthPolicy> power_map;
+    static std::mt19937 rnd{17};
+    std::vector<int> v(10000);
+    for (auto& x : v) {
+        x = rnd();
+        prime_map[x] = x / 2;
+        power_map[x] = x / 3;
+    }
+    for (int x : v) {
+        REQUIRE(prime_map.at(x) == x / 2);
+        REQUIRE(power_map.at(x) == x / 3);
+    }
+    for (int i = 0; i < 1000; ++i) {
+        power_map[i * 1024] = i;
+    }
+    for (int i = 0; i < 1000; ++i) {
+        REQUIRE(power_map[i * 1024] == i);
+    }
+    HashMap<int, int, std::function<size_t(int)>, std::equal_to<int>, PrimeGrowthPolicy> stupid_map(stupid_hash);
+    for (int i = 0; i < 100; ++i) {
+        stupid_map[i] = i;
+    }
+    REQUIRE(stupid_map.size() == 100);
+    REQUIRE(stupid_map.at(57) == 57);
+}
+
+TEST_CASE("Check stored hash") {
+    int calls = 0;
+    HashMap<std::string, int, CountingHasher> mp(CountingHasher{&calls});
+    for (int i = 0; i < 1000; ++i) {
+        mp[std::to_string(i)] = i;
+    }
+    REQUIRE(calls == 1000);
+    for (int i = 0; i < 1000; ++i) {
+        REQUIRE(mp.at(std::to_string(i)) == i);
+    }
+    HashMap<std::string, int, CountingHasher, std::equal_to<std::string>, PowerOfTwoGrowthPolicy, false> rehashing_mp(
+        CountingHasher{&calls});
+    calls = 0;
+    for (int i = 0; i < 1000; ++i) {
+        rehashing_mp[std::to_string(i)] = i;
+    }
+    REQUIRE(calls > 1000);
+}
+
+TEST_CASE("Check wrap-around neighbourhoods") {
+    // The first prime capacity is 5, so every key lands in the last bucket
+    auto last_bucket_hash = [](int) -> size_t { return 4; };
+    HashMap<int, int, decltype(last_bucket_hash), std::equal_to<int>, PrimeGrowthPolicy, false, IdentityHashMixer> mp(
+        last_bucket_hash);
+    for (int i = 0; i < 4; ++i) {
+        mp[i] = i;
+    }
+    REQUIRE(mp.rebuild_count() == 0);
+    mp.erase(1);
+    REQUIRE(mp.find(1) == mp.end());
+    REQUIRE(mp.at(0) == 0);
+    REQUIRE(mp.at(2) == 2);
+    REQUIRE(mp.at(3) == 3);
+    for (int i = 4; i < 100; ++i) {
+        mp[i] = i;
+    }
+    for (int i = 0; i < 100; ++i) {
+        REQUIRE((mp.find(i) == mp.end()) == (i == 1));
+    }
+}
+
+TEST_CASE("Check sizing") {
+    HashMap<int, int> mp;
+    REQUIRE(mp.max_load_factor() > 0);
+    mp.reserve(1000);
+    size_t bucket_count = mp.bucket_count();
+    size_t rebuild_count = mp.rebuild_count();
+    REQUIRE(bucket_count * mp.max_load_factor() >= 1000);
+    for (int i = 0; i < 1000; ++i) {
+        mp[i * 7] = i;
+    }
+    REQUIRE(mp.bucket_count() == bucket_count);
+    REQUIRE(mp.rebuild_count() == rebuild_count);
+    REQUIRE(mp.load_factor() <= mp.max_load_factor());
+    mp.max_load_factor(0.5);
+    REQUIRE(mp.load_factor() <= 0.5);
+    mp.rehash(1 << 16);
+    REQUIRE(mp.bucket_count() >= (1 << 16));
+    mp.rehash(0);
+    REQUIRE(mp.bucket_count() < (1 << 16));
+    REQUIRE(mp.load_factor() <= 0.5);
+    for (int i = 0; i < 1000; ++i) {
+        REQUIRE(mp.at(i * 7) == i);
+    }
+    try {
+        mp.max_load_factor(1.5);
+        FAIL("max_load_factor above 1 is accepted");
+    } catch (const std::invalid_argument&) {
+    }
+
+    std::vector<std::pair<int, int>> v;
+    for (int i = 0; i < 1000; ++i) {
+        v.emplace_back(i, i);
+    }
+    HashMap<int, int> presized(v.begin(), v.end());
+    REQUIRE(presized.size() == 1000);
+    REQUIRE(presized.rebuild_count() == 1);
+}
+
+TEST_CASE("Check neighbourhood growth") {
+    HashMap<int, int, ClusterHasher> mp;
+    mp.reserve(1000);
+    size_t bucket_count = mp.bucket_count();
+    size_t rebuild_count = mp.rebuild_count();
+    for (int i = 0; i < 20; ++i) {
+        mp[i] = i;
+    }
+    REQUIRE(mp.bucket_count() == bucket_count);
+    REQUIRE(mp.rebuild_count() == rebuild_count);
+    for (int i = 0; i < 20; ++i) {
+        REQUIRE(mp.at(i) == i);
+    }
+}
+
+TEST_CASE("Check overflow stash") {
+    // Neighbouring homes under every prime capacity, so growth cannot separate the groups
+    HashMap<int, int, ClusterHasher, std::equal_to<int>, PrimeGrowthPolicy, false, IdentityHashMixer> mp;
+    for (int i = 0; i < 400; ++i) {
+        mp[i] = i;
+    }
+    REQUIRE(mp.size() == 400);
+    REQUIRE(mp.bucket_count() <= 4096);
+    for (int i = 0; i < 400; i += 2) {
+        mp.erase(i);
+    }
+    for (int i = 0; i < 400; ++i) {
+        REQUIRE((mp.find(i) != mp.end()) == (i % 2 == 1));
+    }
+
+    // Only the load grows a table whose stash is made of equal hashes
+    HashMap<int, int, ClusterHasher> grouped;
+    for (int i = 0; i < 5000; ++i) {
+        grouped[i] = i;
+    }
+    REQUIRE(grouped.size() == 5000);
+    REQUIRE(grouped.bucket_count() <= 4 * grouped.size());
+    for (int i = 0; i < 5000; ++i) {
+        REQUIRE(grouped.at(i) == i);
+    }
+}
+
+TEST_CASE("Check stash lookups") {
+    // The first thousand keys share a hash and mostly end up stashed, the rest are spread out
+    struct StashingHasher {
+        size_t operator()(int x) const {
+            return x < 1000 ? 0 : x;
+        }
+    };
+    struct CountingEqual {
+        int* calls;
+        bool operator()(int a, int b) const {
+            ++*calls;
+            return a == b;
+        }
+    };
+    int calls = 0;
+    HashMap<int, int, StashingHasher, CountingEqual> mp(StashingHasher(), CountingEqual{&calls});
+    for (int i = 0; i < 2000; ++i) {
+        mp[i] = i;
+    }
+    for (int i = 0; i < 2000; ++i) {
+        REQUIRE(mp.at(i) == i);
+    }
+
+    // Misses elsewhere neither scan the stash nor compare stashed keys
+    calls = 0;
+    for (int i = 2000; i < 12000; ++i) {
+        REQUIRE(mp.find(i) == mp.end());
+    }
+    REQUIRE(calls < 1000);
+
+    for (int i = 0; i < 1000; i += 2) {
+        mp.erase(i);
+    }
+    for (int i = 0; i < 2000; ++i) {
+        REQUIRE((mp.find(i) != mp.end()) == (i >= 1000 || i % 2 == 1));
+    }
+}
+
+TEST_CASE("Check hash mixing") {
+    AvalancheHashMixer mixer;
+    for (int bit = 0; bit < 64; ++bit) {
+        size_t diff = mixer(0, 0) ^ mixer(size_t{1} << bit, 0);
+        int changed = 0;
+        for (; diff != 0; diff &= diff - 1) {
+            ++changed;
+        }
+        REQUIRE(changed >= 16);
+        REQUIRE(changed <= 48);
+    }
+    REQUIRE(IdentityHashMixer()(12345, 678) == 12345);
+
+    // Multiples of the capacity share a home bucket unless the hash is mixed
+    HashMap<int, int, std::hash<int>, std::equal_to<int>, PrimeGrowthPolicy> mixed;
+    HashMap<int, int, std::hash<int>, std::equal_to<int>, PrimeGrowthPolicy, false, IdentityHashMixer> identity;
+    mixed.reserve(1000);
+    identity.reserve(1000);
+    size_t capacity = mixed.bucket_count();
+    for (int i = 0; i < 100; ++i) {
+        mixed[i * capacity] = i;
+        identity[i * capacity] = i;
+    }
+    REQUIRE(mixed.bucket_count() == capacity);
+    REQUIRE(identity.bucket_count() > capacity);
+    for (int i = 0; i < 100; ++i) {
+        REQUIRE(mixed.at(i * capacity) == i);
+        REQUIRE(identity.at(i * capacity) == i);
+    }
+}
+
+TEST_CASE("Check flooding") {
+    HashMap<int, int> mp;
+    mp.reserve(1000);
+    size_t bucket_count = mp.bucket_count();
+    size_t rebuild_count = mp.rebuild_count();
+
+    // Keys chosen by someone who knows the seed all share one home bucket
+    auto flood = [&mp, bucket_count] {
+        PowerOfTwoGrowthPolicy policy(bucket_count);
+        size_t seed = mp.hash_seed();
+        std::vector<int> keys;
+        for (int i = 0; keys.size() < 100; ++i) {
+            if (policy.GetBucket(AvalancheHashMixer()(i, seed)) == 0) {
+                keys.push_back(i);
+            }
+        }
+        for (int key : keys) {
+            mp[key] = key;
+        }
+        REQUIRE(mp.hash_seed() != seed);
+        REQUIRE(mp.bucket_count() == bucket_count);
+        for (int key : keys) {
+            REQUIRE(mp.at(key) == key);
+        }
+    };
+    flood();
+    REQUIRE(mp.rebuild_count() == rebuild_count + 1);
+
+    // A cleared map defends its next table of the same capacity again
+    mp.clear();
+    mp.reserve(1000);
+    flood();
+}
+
+TEST_CASE("Check transparent lookup") {
+    struct StringHasher {
+        using is_transparent = void;
+
+        size_t operator()(std::string_view s) const {
+            return std::hash<std::string_view>()(s);
+        }
+    };
+    HashMap<std::string, int, StringHasher, std::equal_to<>> mp;
+    const std::string long_key(100, 'x');
+    mp[long_key] = 1;
+    mp["short"] = 2;
+    const char buffer[] = "shortxxx";
+    std::string_view view(buffer, 5);
+    REQUIRE(mp.find(view) != mp.end());
+    REQUIRE(mp.find(view)->second == 2);
+    REQUIRE(mp.at(std::string_view(long_key)) == 1);
+    REQUIRE(mp.at("short") == 2);
+    const auto& const_mp = mp;
+    REQUIRE(const_mp.find(std::string_view("missing")) == const_mp.end());
+    mp.erase(view);
+    REQUIRE(mp.find("short") == mp.end());
+    REQUIRE(mp.size() == 1);
+}
+
+TEST_CASE("Check key equality") {
+    // Keys equal up to case, the hash has to agree
+    struct CaseInsensitiveHasher {
+        size_t operator()(const std::string& s) const {
+            std::string lower = s;
+            std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+            return std::hash<std::string>()(lower);
+        }
+    };
+    struct CaseInsensitiveEqual {
+        bool operator()(const std::string& a, const std::string& b) const {
+            return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+                              [](char x, char y) { return ::tolower(x) == ::tolower(y); });
+        }
+    };
+    HashMap<std::string, int, CaseInsensitiveHasher, CaseInsensitiveEqual> mp;
+    mp["Key"] = 1;
+    mp["KEY"] = 2;
+    REQUIRE(mp.size() == 1);
+    REQUIRE(mp.at("key") == 2);
+    mp.erase("kEy");
+    REQUIRE(mp.empty());
+
+    // A stateless comparison takes no space
+    REQUIRE(std::is_empty_v<hash_map_detail::EmptyBase<CaseInsensitiveEqual>>);
+}
+
+TEST_CASE("Check precomputed hash") {
+    int calls = 0;
+    auto counting_hash = [&calls](int x) -> size_t {
+        ++calls;
+        return x;
+    };
+    HashMap<int, int, decltype(counting_hash)> cache(counting_hash);
+    HashMap<int, int, decltype(counting_hash)> index(counting_hash);
+    decltype(index)::hash_type hash = index.hash_function()(42);
+    calls = 0;
+    index.insert({42, 1}, hash);
+    const std::pair<const int, int> value{42, 2};
+    cache.insert(value, hash);
+    REQUIRE(index.find(42, hash)->second == 1);
+    REQUIRE(std::as_const(cache).find(42, hash)->second == 2);
+    REQUIRE(cache.find(43, index.hash_function()(43)) == cache.end());
+    cache.erase(42, hash);
+    REQUIRE(cache.find(42, hash) == cache.end());
+    REQUIRE(calls == 1);
+    REQUIRE(index.at(42) == 1);
+    REQUIRE(calls == 2);
+}
+
+TEST_CASE("Check emplace") {
+    CountedValue::init();
+    HashMap<int, CountedValue> mp;
+    REQUIRE(mp.try_emplace(1, 10).second);
+    REQUIRE(!mp.try_emplace(1, 20).second);
+    REQUIRE(mp.at(1).x == 10);
+    REQUIRE(CountedValue::constructed == 1);
+
+    mp[2].x = 5;
+    mp[2].x += 1;
+    REQUIRE(mp.at(2).x == 6);
+    REQUIRE(CountedValue::constructed == 2);
+
+    auto [it, inserted] = mp.emplace(3, 30);
+    REQUIRE(inserted);
+    REQUIRE(it->second.x == 30);
+    REQUIRE(!mp.emplace(3, 31).second);
+    REQUIRE(mp.at(3).x == 30);
+    REQUIRE(mp.size() == 3);
+
+    REQUIRE(!mp.insert_or_assign(1, CountedValue(11)).second);
+    REQUIRE(mp.at(1).x == 11);
+    REQUIRE(mp.insert_or_assign(4, CountedValue(40)).second);
+    REQUIRE(mp.at(4).x == 40);
+    REQUIRE(CountedValue::copied == 1);  // CountedValue has no move constructor
+
+    HashMap<std::string, std::vector<int>> vectors;
+    std::string key = "key";
+    vectors.try_emplace(std::move(key), 3, 7);
+    REQUIRE(vectors.at("key") == std::vector<int>{7, 7, 7});
+
+    // The key refers into the map, and inserting it may grow the slot array
+    HashMap<int, int> chain;
+    chain[0] = 1;
+    for (int i = 1; i < 1000; ++i) {
+        chain[chain[i - 1]] = i + 1;
+    }
+    REQUIRE(chain.size() == 1000);
+    for (int i = 0; i < 1000; ++i) {
+        REQUIRE(chain.at(i) == i + 1);
+    }
+    auto name = [](int i) {
+        return "a key too long for the small string buffer " + std::to_string(i);
+    };
+    HashMap<std::string, std::string> names;
+    names[name(0)] = name(1);
+    for (int i = 1; i < 1000; ++i) {
+        names[names[name(i - 1)]] = name(i + 1);
+    }
+    REQUIRE(names.size() == 1000);
+    for (int i = 0; i < 1000; ++i) {
+        REQUIRE(names.at(name(i)) == name(i + 1));
+    }
+}
+
+TEST_CASE("Check iterator erase") {
+    int calls = 0;
+    HashMap<std::string, int, CountingHasher> mp(CountingHasher{&calls});
+    for (int i = 0; i < 100; ++i) {
+        mp[std::to_string(i)] = i;
+    }
+    auto it = mp.find("42");
+    auto next = it;
+    ++next;
+    calls = 0;
+    REQUIRE(mp.erase(it) == next);
+    REQUIRE(calls == 0);
+    REQUIRE(mp.size() == 99);
+    REQUIRE(mp.find("42") == mp.end());
+
+    // Without stored hashes the home bucket still comes from the bucket the slot remembers
+    HashMap<std::string, int, CountingHasher, std::equal_to<std::string>, PowerOfTwoGrowthPolicy, false> rehashing_mp(
+        CountingHasher{&calls});
+    for (int i = 0; i < 100; ++i) {
+        rehashing_mp[std::to_string(i)] = i;
+    }
+    calls = 0;
+    for (auto pos = rehashing_mp.begin(); pos != rehashing_mp.end();) {
+        pos = pos->second % 2 == 0 ? rehashing_mp.erase(pos) : std::next(pos);
+    }
+    REQUIRE(calls == 0);
+    REQUIRE(rehashing_mp.size() == 50);
+    for (int i = 0; i < 100; ++i) {
+        REQUIRE((rehashing_mp.find(std::to_string(i)) != rehashing_mp.end()) == (i % 2 == 1));
+    }
+
+    for (auto pos = mp.begin(); pos != mp.end();) {
+        pos = pos->second % 3 == 0 ? mp.erase(pos) : std::next(pos);
+    }
+    REQUIRE(mp.size() == 66);
+    REQUIRE(erase_if(mp, [](const auto& object) { return object.second % 3 == 1; }) == 33);
+    REQUIRE(mp.size() == 33);
+    for (const auto& [key, value] : mp) {
+        REQUIRE(value % 3 == 2);
+        REQUIRE(mp.at(key) == value);
+    }
+
+    auto first = mp.begin();
+    std::advance(first, 3);
+    auto last = first;
+    std::advance(last, 10);
+    REQUIRE(mp.erase(first, last) == last);
+    REQUIRE(mp.size() == 23);
+    REQUIRE(mp.erase(mp.begin(), mp.end()) == mp.end());
+    REQUIRE(mp.empty());
+}
+
+TEST_CASE("Check node handles") {
+    HashMap<int, std::vector<int>> hot;
+    HashMap<int, std::vector<int>> cold;
+    for (int i = 0; i < 10; ++i) {
+        hot[i] = std::vector<int>(100, i);
+    }
+    const int* data = hot.at(3).data();
+    auto node = hot.extract(3);
+    REQUIRE(!node.empty());
+    REQUIRE(node.key() == 3);
+    REQUIRE(hot.find(3) == hot.end());
+    REQUIRE(hot.size() == 9);
+
+    // Moving a handle leaves the source empty
+    auto moved = std::move(node);
+    REQUIRE(node.empty());
+    REQUIRE(moved.key() == 3);
+    node = std::move(moved);
+    REQUIRE(moved.empty());
+    REQUIRE(node.key() == 3);
+
+    auto result = cold.insert(std::move(node));
+    REQUIRE(node.empty());
+    REQUIRE(result.inserted);
+    REQUIRE(result.node.empty());
+    REQUIRE(result.position->first == 3);
+    REQUIRE(cold.at(3).data() == data);
+
+    REQUIRE(hot.extract(3).empty());
+    REQUIRE(!cold.insert(decltype(cold)::node_type()).inserted);
+
+    cold[4] = {1};
+    node = hot.extract(hot.find(4));
+    node.mapped().push_back(5);
+    result = cold.insert(std::move(node));
+    REQUIRE(!result.inserted);
+    REQUIRE(node.empty());
+    REQUIRE(result.node.key() == 4);
+    REQUIRE(result.position == cold.find(4));
+    REQUIRE(result.node.mapped().size() == 101);
+    REQUIRE(cold.at(4) == std::vector<int>{1});
+
+    result.node.key() = 40;
+    REQUIRE(cold.insert(std::move(result.node)).inserted);
+    REQUIRE(cold.at(40).size() == 101);
+    REQUIRE(hot.size() == 8);
+}
+
+TEST_CASE("Check merge") {
+    HashMap<std::string, std::vector<int>> global;
+    HashMap<std::string, std::vector<int>> partial;
+    for (int i = 0; i < 100; ++i) {
+        partial[std::to_string(i)] = std::vector<int>(10, i);
+    }
+    for (int i = 0; i < 100; i += 4) {
+        global[std::to_string(i)] = {};
+    }
+    const int* data = partial.at("1").data();
+    global.merge(partial);
+    REQUIRE(global.size() == 100);
+    REQUIRE(partial.size() == 25);
+    REQUIRE(global.at("1").data() == data);
+    for (int i = 0; i < 100; ++i) {
+        std::string key = std::to_string(i);
+        if (i % 4 == 0) {
+            REQUIRE(global.at(key).empty());
+            REQUIRE(partial.at(key) == std::vector<int>(10, i));
+        } else {
+            REQUIRE(global.at(key) == std::vector<int>(10, i));
+            REQUIRE(partial.find(key) == partial.end());
+        }
+    }
+    global.merge(global);
+    REQUIRE(global.size() == 100);
+
+    HashMap<std::string, std::vector<int>> empty;
+    empty.merge(std::move(partial));
+    REQUIRE(empty.size() == 25);
+    REQUIRE(partial.empty());
+
+    // Keys move with their stored hash
+    int calls = 0;
+    HashMap<std::string, int, CountingHasher> source(CountingHasher{&calls});
+    HashMap<std::string, int, CountingHasher> target(CountingHasher{&calls});
+    std::string long_key = "a key outside the small string buffer";
+    source[long_key] = -1;
+    for (int i = 0; i < 1000; ++i) {
+        source[std::to_string(i)] = i;
+    }
+    target["0"] = 0;
+    const char* key_data = source.find(long_key)->first.data();
+    calls = 0;
+    target.merge(source);
+    REQUIRE(calls == 0);
+    REQUIRE(target.size() == 1001);
+    REQUIRE(source.size() == 1);
+    REQUIRE(target.find(long_key)->first.data() == key_data);
+    REQUIRE(source.at("0") == 0);
+}
+
+TEST_CASE("Check copy layout") {
+    HashMap<std::string, int> mp;
+    mp.incremental_growth(true);
+    for (int i = 0; i < 5000; ++i) {
+        mp[std::to_string(i)] = i;
+    }
+    for (int i = 0; i < 5000; i += 3) {
+        mp.erase(std::to_string(i));
+    }
+    HashMap<std::string, int> copy(mp);
+    REQUIRE(copy.rebuild_count() == 0);
+    REQUIRE(copy.size() == mp.size());
+    REQUIRE(copy.bucket_count() == mp.bucket_count());
+    REQUIRE(std::equal(copy.begin(), copy.end(), mp.begin(), mp.end()));
+    for (int i = 5000; i < 10000; ++i) {
+        copy[std::to_string(i)] = i;
+    }
+    for (int i = 0; i < 10000; ++i) {
+        std::string key = std::to_string(i);
+        REQUIRE((copy.find(key) != copy.end()) == (i >= 5000 || i % 3 != 0));
+        REQUIRE((mp.find(key) != mp.end()) == (i < 5000 && i % 3 != 0));
+    }
+}
+
+TEST_CASE("Check move") {
+    using Map = HashMap<std::string, int>;
+    static_assert(std::is_nothrow_move_constructible_v<Map>);
+    static_assert(std::is_nothrow_move_assignable_v<Map>);
+
+    Map mp{{"a", 1}, {"b", 2}};
+    Map moved(std::move(mp));
+    REQUIRE(moved.size() == 2);
+    REQUIRE(mp.empty());
+    REQUIRE(mp.bucket_count() == 0);
+    REQUIRE(mp.find("a") == mp.end());
+    mp["c"] = 3;
+    REQUIRE(mp.at("c") == 3);
+
+    moved = std::move(mp);
+    REQUIRE(moved.size() == 1);
+    REQUIRE(moved.at("c") == 3);
+    REQUIRE(mp.empty());
+    REQUIRE(mp.bucket_count() == 0);
+    REQUIRE(mp.load_factor() == 0);
+    moved = std::move(moved);
+    REQUIRE(moved.size() == 1);
+
+    // A capturing lambda has no default constructor, so moving must not need one
+    size_t offset = 1;
+    auto hasher = [offset](int x) -> size_t { return x + offset; };
+    static_assert(!std::is_default_constructible_v<decltype(hasher)>);
+    HashMap<int, int, decltype(hasher)> lambda_map(hasher);
+    lambda_map[1] = 1;
+    HashMap<int, int, decltype(hasher)> lambda_moved(std::move(lambda_map));
+    REQUIRE(lambda_moved.at(1) == 1);
+
+    std::vector<Map> maps(1);
+    maps[0]["x"] = 1;
+    const Map* before = maps.data();
+    const int* value = &maps[0].at("x");
+    while (maps.data() == before) {
+        maps.emplace_back();
+    }
+    REQUIRE(&maps[0].at("x") == value);
+}
+
+TEST_CASE("Check empty map") {
+    HashMap<std::string, int> mp;
+    REQUIRE(mp.bucket_count() == 0);
+    REQUIRE(mp.find("a") == mp.end());
+    REQUIRE(std::as_const(mp).find("a") == mp.end());
+    REQUIRE(mp.extract("a").empty());
+    REQUIRE(mp.load_factor() == 0);
+    mp.erase("a");
+    try {
+        mp.at("a");
+        FAIL("at on an empty map found something");
+    } catch (const std::out_of_range&) {
+    }
+    REQUIRE(mp.bucket_count() == 0);
+
+    mp["a"] = 1;
+    REQUIRE(mp.bucket_count() > 0);
+    REQUIRE(mp.at("a") == 1);
+    mp.clear();
+    REQUIRE(mp.bucket_count() == 0);
+    REQUIRE(mp.find("a") == mp.end());
+    mp["b"] = 2;
+    REQUIRE(mp.size() == 1);
+
+    HashMap<int, int, std::hash<int>, std::equal_to<int>, PrimeGrowthPolicy> prime_map;
+    prime_map.incremental_growth(true);
+    prime_map[1] = 1;
+    REQUIRE(prime_map.bucket_count() == 5);
+    REQUIRE(prime_map.at(1) == 1);
+}
+
+TEST_CASE("Check map size") {
+    // Stash and migration state live behind pointers, an empty map should stay small
+    STATIC_REQUIRE(sizeof(HashMap<int, int>) <= 144);
+    STATIC_REQUIRE(sizeof(HashMap<std::string, int>) <= 144);
+}
+
+TEST_CASE("Check incremental growth") {
+    HashMap<int, int> mp;
+    mp.incremental_growth(true);
+    REQUIRE(mp.incremental_growth());
+    std::map<int, int> norm_mp;
+    static std::mt19937 rnd{239};
+    std::vector<int> v(100000);
+    for (int i = 0; i < 100000; ++i) {
+        v[i] = rnd();
+        mp[v[i]] = i;
+        norm_mp[v[i]] = i;
+        int probe = v[rnd() % (i + 1)];
+        REQUIRE((mp.find(probe) == mp.end()) == (norm_mp.find(probe) == norm_mp.end()));
+        if (i % 3 == 0) {
+            int victim = v[rnd() % (i + 1)];
+            mp.erase(victim);
+            norm_mp.erase(victim);
+        }
+    }
+    REQUIRE(mp.size() == norm_mp.size());
+    for (int x : v) {
+        auto it = mp.find(x);
+        auto it2 = norm_mp.find(x);
+        REQUIRE((it == mp.end()) == (it2 == norm_mp.end()));
+        if (it2 != norm_mp.end()) {
+            REQUIRE(it->second == it2->second);
+        }
+    }
+    mp.incremental_growth(false);
+    HashMap<int, int> copy(mp);
+    REQUIRE(copy.size() == norm_mp.size());
+
+    HashMap<int, int, std::function<size_t(int)>> stupid_map(stupid_hash);
+    stupid_map.incremental_growth(true);
+    for (int i = 0; i < 1000; ++i) {
+        stupid_map[i] = i;
+    }
+    for (int i = 0; i < 1000; i += 2) {
+        stupid_map.erase(i);
+    }
+    for (int i = 0; i < 1000; ++i) {
+        REQUIRE((stupid_map.find(i) == stupid_map.end()) == (i % 2 == 0));
+    }
+}
+
+TEST_CASE("Insert tail latency", "[.][benchmark]") {
+    // Long enough keys that every one of them owns an allocation
+    std::vector<std::string> keys(1 << 21);
+    std::mt19937 rnd{1};
+    for (auto& key : keys) {
+        key = "a key outside the small string buffer " + std::to_string(rnd());
+    }
+    for (bool incremental : {false, true}) {
+        HashMap<std::string, int> mp;
+        mp.incremental_growth(incremental);
+        std::chrono::nanoseconds worst{0};
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < keys.size(); ++i) {
+            auto before = std::chrono::steady_clock::now();
+            mp[keys[i]] = i;
+            worst = std::max(worst, std::chrono::steady_clock::now() - before);
+        }
+        auto total = std::chrono::steady_clock::now() - start;
+        std::cout << (incremental ? "incremental" : "stop-the-world") << " growth: worst insert "
+                  << std::chrono::duration_cast<std::chrono::microseconds>(worst).count() << " us, total "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(total).count() << " ms\n";
+    }
+}